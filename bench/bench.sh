@@ -0,0 +1,323 @@
+#!/bin/bash
+# Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+#    this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Generates deterministic synthetic corpora, converts each one and prints
+# one "<corpus>.<metric> <value> <unit>" line per measurement, so runs can
+# be diffed across commits. Per-stage times come from --profile spans and
+# byte counts from --stats of the same run.
+#
+#   BENCH_SCALE=<n>  divide corpus sizes by <n> for a quick run
+#   BENCH_DIR=<dir>  generate corpora in <dir> and keep them
+#
+# Any arguments select a subset of: sprites tileset palette appvar zx0
+
+set -e
+
+cd "$(dirname "$0")"
+
+BIN="$(cd ../bin && pwd)"
+CONVIMG="$BIN/convimg"
+GEN="$BIN/benchgen"
+SCALE=${BENCH_SCALE:-1}
+
+if [ -n "$BENCH_DIR" ]
+then
+    WORK="$BENCH_DIR"
+    mkdir -p "$WORK"
+else
+    WORK="$(mktemp -d)"
+    trap 'rm -rf "$WORK"' EXIT
+fi
+
+scaled()
+{
+    local n=$(( $1 / SCALE ))
+    (( n < $2 )) && n=$2
+    echo $n
+}
+
+report()
+{
+    printf '%-36s %14s %s\n' "$1.$2" "$3" "$4"
+}
+
+per_second()
+{
+    awk -v n="$1" -v ms="$2" 'BEGIN { printf "%.3f", ms > 0 ? n / ms * 1000 : 0 }'
+}
+
+# runs the project in the current directory and reports its counters
+measure()
+{
+    local name=$1
+    local result
+    local wall
+    local rss
+    local input
+
+    result=$("$GEN" run run.log "$CONVIMG" -i convimg.yaml -p profile.json -s text) || {
+        echo "[bench] $name failed, see $PWD/run.log" >&2
+        exit 1
+    }
+    read -r wall rss <<< "$result"
+
+    input=$(cat ./*.png | wc -c)
+
+    awk -v corpus="$name" -v wall="$wall" -v rss="$rss" -v input="$input" '
+        function out(metric, value, unit)
+        {
+            printf "%-36s %14s %s\n", corpus "." metric, value, unit
+        }
+        function rate(n, ms)
+        {
+            return sprintf("%.3f", ms > 0 ? n / ms * 1000 : 0)
+        }
+        $1 == "[stats]" && $2 == "total" { pixels = $5; quantizes = $7 }
+        $1 == "[stats]" && $2 == "palette" { totals_done = 1 }
+        $1 == "[stats]" && $4 == "calls" && !totals_done { stage_in[$2] = $5; stage_out[$2] = $7; stage_ms[$2] = $10; stages[++n] = $2 }
+        $1 == "[stats]" && $2 == "written" { files = $3; written = $5 }
+        $1 == "[profile]" && $2 != "stage" { profile_ms[$2] = $4; profiles[++m] = $2 }
+        END {
+            out("wall_ms", wall, "ms")
+            out("peak_rss_kb", rss, "KiB")
+            out("input_mb", sprintf("%.3f", input / 1048576), "MB")
+            out("input_mb_per_s", rate(input / 1048576, wall), "MB/s")
+            out("decoded_mpix", sprintf("%.3f", pixels / 1000000), "Mpx")
+            out("mpix_per_s", rate(pixels / 1000000, wall), "Mpx/s")
+            out("quantizes", quantizes, "calls")
+            out("files_written", files, "files")
+            out("written_mb", sprintf("%.3f", written / 1048576), "MB")
+            for (i = 1; i <= m; ++i)
+            {
+                s = profiles[i]
+                out("stage." s ".ms", profile_ms[s], "ms")
+            }
+            out("stage.decode.mpix_per_s", rate(pixels / 1000000, profile_ms["decode"]), "Mpx/s")
+            out("stage.write.mb_per_s", rate(written / 1048576, profile_ms["write"]), "MB/s")
+            for (i = 1; i <= n; ++i)
+            {
+                s = stages[i]
+                out("codec." s ".in_mb", sprintf("%.3f", stage_in[s] / 1048576), "MB")
+                out("codec." s ".ratio", sprintf("%.4f", stage_in[s] ? stage_out[s] / stage_in[s] : 0), "out/in")
+                if (stage_ms[s] > 0)
+                {
+                    out("codec." s ".mb_per_s", rate(stage_in[s] / 1048576, stage_ms[s]), "MB/s")
+                }
+            }
+        }' run.log
+}
+
+corpus_begin()
+{
+    rm -rf "${WORK:?}/$1"
+    mkdir -p "$WORK/$1"
+    cd "$WORK/$1"
+}
+
+# many small sprites sharing one automatic palette
+bench_sprites()
+{
+    local count
+    count=$(scaled 1000 10)
+
+    corpus_begin sprites
+    "$GEN" png sprite 32 32 "$count" sprite_
+
+    cat > convimg.yaml <<YAML
+palettes:
+  - name: pal
+    images: automatic
+
+converts:
+  - name: sprites
+    palette: pal
+    style: rlet
+    images:
+      - sprite_*.png
+
+outputs:
+  - type: c
+    include-file: gfx.h
+    palettes:
+      - pal
+    converts:
+      - sprites
+YAML
+
+    measure sprites
+}
+
+# one large tileset of 16x16 tiles
+bench_tileset()
+{
+    local size
+    size=$(scaled 4096 256)
+    size=$(( size / 16 * 16 ))
+
+    corpus_begin tileset
+    "$GEN" png tiles "$size" "$size" 1 tileset_
+
+    cat > convimg.yaml <<YAML
+palettes:
+  - name: pal
+    images: automatic
+
+converts:
+  - name: tileset
+    palette: pal
+    tilesets:
+      tile-width: 16
+      tile-height: 16
+      images:
+        - tileset_0000.png
+
+outputs:
+  - type: bin
+    include-file: tileset.h
+    palettes:
+      - pal
+    converts:
+      - tileset
+YAML
+
+    measure tileset
+}
+
+# about 200 MB of photographic input feeding one automatic palette
+bench_palette()
+{
+    local count
+    count=$(scaled 50 1)
+
+    corpus_begin palette
+    "$GEN" png photo 1024 1024 "$count" photo_
+
+    cat > convimg.yaml <<YAML
+palettes:
+  - name: pal
+    images: automatic
+
+converts:
+  - name: photos
+    palette: pal
+    width-and-height: false
+    images:
+      - photo_*.png
+
+outputs:
+  - type: bin
+    include-file: photos.h
+    palettes:
+      - pal
+    converts:
+      - photos
+YAML
+
+    measure palette
+}
+
+# many appvar outputs, each with its own convert
+bench_appvar()
+{
+    local count
+    count=$(scaled 64 2)
+
+    corpus_begin appvar
+    "$GEN" png sprite 32 32 $(( count * 8 )) sprite_
+
+    {
+        printf 'palettes:\n  - name: pal\n    images: automatic\n\nconverts:\n'
+        for (( i = 0; i < count; ++i ))
+        do
+            printf '  - name: set%03d\n    palette: pal\n    images:\n' $i
+            for (( j = 0; j < 8; ++j ))
+            do
+                printf '      - sprite_%04d.png\n' $(( i * 8 + j ))
+            done
+        done
+        printf '\noutputs:\n'
+        for (( i = 0; i < count; ++i ))
+        do
+            printf '  - type: appvar\n    name: BENCH%03d\n    source-format: c\n' $i
+            printf '    include-file: set%03d.h\n    converts:\n      - set%03d\n' $i $i
+        done
+    } > convimg.yaml
+
+    measure appvar
+}
+
+# highly compressible images that spend most of the run in zx0
+bench_zx0()
+{
+    local count
+    count=$(scaled 64 2)
+
+    corpus_begin zx0
+    "$GEN" png flat 160 120 "$count" flat_
+
+    cat > convimg.yaml <<YAML
+palettes:
+  - name: pal
+    images: automatic
+
+converts:
+  - name: flat
+    palette: pal
+    compress: zx0
+    images:
+      - flat_*.png
+
+outputs:
+  - type: c
+    include-file: flat.h
+    palettes:
+      - pal
+    converts:
+      - flat
+YAML
+
+    measure zx0
+}
+
+CORPORA=${*:-sprites tileset palette appvar zx0}
+
+report bench scale "$SCALE" "divisor"
+
+for corpus in $CORPORA
+do
+    case "$corpus" in
+        sprites|tileset|palette|appvar|zx0)
+            ( "bench_$corpus" )
+            ;;
+        *)
+            echo "[bench] unknown corpus '$corpus'" >&2
+            exit 1
+            ;;
+    esac
+done
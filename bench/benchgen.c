@@ -0,0 +1,434 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* generates deterministic png corpora and measures benchmark runs */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define BLOCK_SIZE 65535
+#define NR_TILES 64
+
+struct png
+{
+    FILE *fd;
+    uint8_t block[5 + BLOCK_SIZE];
+    uint32_t len;
+    uint32_t adler_a;
+    uint32_t adler_b;
+};
+
+struct gen
+{
+    uint32_t state;
+    uint32_t seed;
+    uint32_t width;
+    uint32_t height;
+    uint32_t colors[16];
+};
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t c = i;
+
+        for (int k = 0; k < 8; ++k)
+        {
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static void put_be32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value >> 24;
+    dst[1] = value >> 16;
+    dst[2] = value >> 8;
+    dst[3] = value;
+}
+
+static void png_chunk(FILE *fd, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t header[8];
+    uint8_t footer[4];
+    uint32_t crc;
+
+    put_be32(header, len);
+    memcpy(header + 4, type, 4);
+
+    crc = crc_update(0xffffffff, header + 4, 4);
+    crc = crc_update(crc, data, len) ^ 0xffffffff;
+    put_be32(footer, crc);
+
+    fwrite(header, 1, 8, fd);
+    fwrite(data, 1, len, fd);
+    fwrite(footer, 1, 4, fd);
+}
+
+/* pixel data is stored uncompressed, one deflate block per IDAT chunk */
+static void png_flush(struct png *png, bool last)
+{
+    uint32_t len = png->len;
+
+    png->block[0] = last ? 1 : 0;
+    png->block[1] = len & 0xff;
+    png->block[2] = len >> 8;
+    png->block[3] = ~len & 0xff;
+    png->block[4] = (~len >> 8) & 0xff;
+
+    png_chunk(png->fd, "IDAT", png->block, 5 + len);
+    png->len = 0;
+}
+
+static void png_write(struct png *png, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        png->adler_a = (png->adler_a + data[i]) % 65521;
+        png->adler_b = (png->adler_b + png->adler_a) % 65521;
+
+        png->block[5 + png->len++] = data[i];
+        if (png->len == BLOCK_SIZE)
+        {
+            png_flush(png, false);
+        }
+    }
+}
+
+static uint32_t gen_next(struct gen *gen)
+{
+    uint32_t x = gen->state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return gen->state = x;
+}
+
+static uint32_t gen_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+
+    return x;
+}
+
+static void gen_init(struct gen *gen, uint32_t seed, uint32_t width, uint32_t height)
+{
+    gen->state = gen_hash(seed) | 1;
+    gen->seed = seed;
+    gen->width = width;
+    gen->height = height;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        gen->colors[i] = gen_next(gen) | 0xff000000;
+    }
+}
+
+static void set_rgba(uint8_t *px, uint32_t rgba)
+{
+    px[0] = rgba;
+    px[1] = rgba >> 8;
+    px[2] = rgba >> 16;
+    px[3] = rgba >> 24;
+}
+
+/* an opaque shaded ellipse on a transparent background */
+static void gen_sprite(struct gen *gen, uint32_t x, uint32_t y, uint8_t *px)
+{
+    int32_t cx = gen->width / 2;
+    int32_t cy = gen->height / 2;
+    int32_t dx = ((int32_t)x - cx) * 256 / (cx ? cx : 1);
+    int32_t dy = ((int32_t)y - cy) * 256 / (cy ? cy : 1);
+    int32_t d = dx * dx + dy * dy;
+
+    if (d > 256 * 256)
+    {
+        set_rgba(px, 0);
+        return;
+    }
+
+    set_rgba(px, gen->colors[(d >> 13) & 7]);
+}
+
+/* smooth gradients with grain, so quantization has real work to do */
+static void gen_photo(struct gen *gen, uint32_t x, uint32_t y, uint8_t *px)
+{
+    uint32_t grain = gen_next(gen);
+
+    px[0] = (x * 255 / gen->width + (grain & 15) + gen->seed * 37) & 0xff;
+    px[1] = (y * 255 / gen->height + ((grain >> 4) & 15)) & 0xff;
+    px[2] = ((x + y) * 127 / gen->width + ((grain >> 8) & 15) + gen->seed * 11) & 0xff;
+    px[3] = 255;
+}
+
+/* a grid of 16x16 tiles picked from a small set of patterns */
+static void gen_tiles(struct gen *gen, uint32_t x, uint32_t y, uint8_t *px)
+{
+    uint32_t tile = gen_hash(((y / 16) * 4096 + (x / 16)) ^ gen->seed) % NR_TILES;
+    uint32_t pattern = gen_hash(tile * 256 + (y % 16) * 16 + (x % 16));
+
+    set_rgba(px, gen->colors[(tile + (pattern & 3)) & 15]);
+}
+
+/* long runs and repeated rows, the best case for zx0 */
+static void gen_flat(struct gen *gen, uint32_t x, uint32_t y, uint8_t *px)
+{
+    uint32_t band = gen_hash((y / 8) ^ gen->seed);
+
+    set_rgba(px, gen->colors[((x / (4 + (band & 15))) + band) & 3]);
+}
+
+static int write_png(const char *path, const char *kind, uint32_t width, uint32_t height, uint32_t seed)
+{
+    static struct png png;
+    void (*pixel)(struct gen *, uint32_t, uint32_t, uint8_t *);
+    uint8_t ihdr[13];
+    uint8_t zlib[2] = { 0x78, 0x01 };
+    uint8_t adler[4];
+    uint8_t *row;
+    struct gen gen;
+
+    if (!strcmp(kind, "sprite"))
+    {
+        pixel = gen_sprite;
+    }
+    else if (!strcmp(kind, "photo"))
+    {
+        pixel = gen_photo;
+    }
+    else if (!strcmp(kind, "tiles"))
+    {
+        pixel = gen_tiles;
+    }
+    else if (!strcmp(kind, "flat"))
+    {
+        pixel = gen_flat;
+    }
+    else
+    {
+        fprintf(stderr, "unknown kind '%s'\n", kind);
+        return -1;
+    }
+
+    row = malloc(1 + (size_t)width * 4);
+    if (row == NULL)
+    {
+        return -1;
+    }
+
+    png.fd = fopen(path, "wb");
+    if (png.fd == NULL)
+    {
+        fprintf(stderr, "could not open '%s'\n", path);
+        free(row);
+        return -1;
+    }
+
+    png.len = 0;
+    png.adler_a = 1;
+    png.adler_b = 0;
+
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, png.fd);
+
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = 6;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    png_chunk(png.fd, "IHDR", ihdr, sizeof ihdr);
+    png_chunk(png.fd, "IDAT", zlib, sizeof zlib);
+
+    gen_init(&gen, seed, width, height);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        row[0] = 0;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            pixel(&gen, x, y, &row[1 + x * 4]);
+        }
+
+        png_write(&png, row, 1 + width * 4);
+    }
+
+    png_flush(&png, true);
+
+    put_be32(adler, (png.adler_b << 16) | png.adler_a);
+    png_chunk(png.fd, "IDAT", adler, sizeof adler);
+    png_chunk(png.fd, "IEND", NULL, 0);
+
+    fclose(png.fd);
+    free(row);
+
+    return 0;
+}
+
+static int gen_main(char *argv[])
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t count;
+    char path[4096];
+
+    width = strtoul(argv[3], NULL, 0);
+    height = strtoul(argv[4], NULL, 0);
+    count = strtoul(argv[5], NULL, 0);
+    if (width == 0 || height == 0 || width > 16384 || height > 16384)
+    {
+        fprintf(stderr, "invalid size %ux%u\n", width, height);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        snprintf(path, sizeof path, "%s%04u.png", argv[6], i);
+
+        if (write_png(path, argv[2], width, height, i + 1))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* prints wall time in ms and the peak rss of the child in KiB */
+static int run_main(char *argv[])
+{
+#ifdef _WIN32
+    (void)argv;
+    fprintf(stderr, "run is not supported on this platform\n");
+    return -1;
+#else
+    struct timespec start;
+    struct timespec end;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+        {
+            _exit(127);
+        }
+
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        execvp(argv[3], &argv[3]);
+        _exit(127);
+    }
+
+    if (wait4(pid, &status, 0, &usage) < 0)
+    {
+        perror("wait4");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("%.3f %ld\n",
+        (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0,
+        (long)usage.ru_maxrss);
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    int ret;
+
+    crc_init();
+
+    if (argc == 7 && !strcmp(argv[1], "png"))
+    {
+        ret = gen_main(argv);
+    }
+    else if (argc >= 4 && !strcmp(argv[1], "run"))
+    {
+        ret = run_main(argv);
+    }
+    else
+    {
+        fprintf(stderr, "usage: %s png <sprite|photo|tiles|flat> <width> <height> <count> <prefix>\n", argv[0]);
+        fprintf(stderr, "       %s run <stdout log> <program> [args...]\n", argv[0]);
+        ret = -1;
+    }
+
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -89,6 +89,7 @@ struct appvar
     uint32_t data_offset;
     appvar_source_t source;
     compress_mode_t compress;
+    uint32_t budget;
 };
 
 int appvar_write(struct appvar *a, const char *path);
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "banks.h"
+#include "memory.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* local index 0 of every bank is the transparent index */
+#define BANKS_FIRST_COLOR 1
+
+struct banks_color
+{
+    uint8_t index;
+    uint32_t count;
+};
+
+struct banks_tile
+{
+    uint32_t counts[PALETTE_MAX_ENTRIES];
+    uint32_t nr_colors;
+    uint32_t index;
+};
+
+struct banks_bank
+{
+    uint8_t colors[TILESET_BANK_SIZE];
+    uint32_t nr_colors;
+};
+
+static int banks_tile_cmp(const void *a, const void *b)
+{
+    const struct banks_tile *ta = a;
+    const struct banks_tile *tb = b;
+
+    if (ta->nr_colors != tb->nr_colors)
+    {
+        return ta->nr_colors < tb->nr_colors ? 1 : -1;
+    }
+
+    return ta->index < tb->index ? -1 : 1;
+}
+
+static int banks_color_cmp(const void *a, const void *b)
+{
+    const struct banks_color *ca = a;
+    const struct banks_color *cb = b;
+
+    if (ca->count != cb->count)
+    {
+        return ca->count < cb->count ? 1 : -1;
+    }
+
+    return ca->index < cb->index ? -1 : 1;
+}
+
+static bool banks_has(const struct banks_bank *bank, uint8_t index)
+{
+    for (uint32_t i = 0; i < bank->nr_colors; ++i)
+    {
+        if (bank->colors[i] == index)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint8_t banks_nearest(const struct banks_bank *bank, const struct palette *palette, uint8_t index)
+{
+    uint32_t best = UINT32_MAX;
+    uint8_t local = 0;
+
+    for (uint32_t i = BANKS_FIRST_COLOR; i < bank->nr_colors; ++i)
+    {
+        uint32_t dist = palette_color_distance(&palette->entries[bank->colors[i]].color,
+            &palette->entries[index].color);
+
+        if (dist < best)
+        {
+            best = dist;
+            local = i;
+        }
+    }
+
+    return local;
+}
+
+/* colors of a tile missing from a bank, most used first */
+static uint32_t banks_missing(const struct banks_bank *bank,
+    const struct banks_tile *tile,
+    struct banks_color *missing)
+{
+    uint32_t nr_missing = 0;
+
+    for (uint32_t i = 0; i < PALETTE_MAX_ENTRIES; ++i)
+    {
+        if (tile->counts[i] && !banks_has(bank, i))
+        {
+            missing[nr_missing].index = i;
+            missing[nr_missing].count = tile->counts[i];
+            nr_missing++;
+        }
+    }
+
+    qsort(missing, nr_missing, sizeof(struct banks_color), banks_color_cmp);
+
+    return nr_missing;
+}
+
+static void banks_add(struct banks_bank *bank, const struct banks_color *missing, uint32_t nr_missing)
+{
+    for (uint32_t i = 0; i < nr_missing && bank->nr_colors < TILESET_BANK_SIZE; ++i)
+    {
+        bank->colors[bank->nr_colors++] = missing[i].index;
+    }
+}
+
+/* pixel weighted distance of the colors left out once free slots are filled */
+static uint64_t banks_error(const struct banks_bank *bank,
+    const struct palette *palette,
+    const struct banks_color *missing,
+    uint32_t nr_missing)
+{
+    struct banks_bank merged = *bank;
+    uint64_t error = 0;
+
+    banks_add(&merged, missing, nr_missing);
+
+    for (uint32_t i = 0; i < nr_missing; ++i)
+    {
+        uint8_t local;
+
+        if (banks_has(&merged, missing[i].index))
+        {
+            continue;
+        }
+
+        local = banks_nearest(&merged, palette, missing[i].index);
+
+        error += (uint64_t)missing[i].count * palette_color_distance(
+            &palette->entries[merged.colors[local]].color,
+            &palette->entries[missing[i].index].color);
+    }
+
+    return error;
+}
+
+/*
+ * Greedily packs tiles into banks of 16 palette indices, most colorful
+ * tiles first. A tile joins the bank needing the fewest new colors, opens
+ * a new bank if none has room, and otherwise joins the bank that loses the
+ * least color. Tile indices are then replaced with 4-bit bank indices.
+ */
+int banks_generate(struct tileset *tileset,
+    const struct palette *palette,
+    uint32_t max_banks,
+    uint8_t transparent_index)
+{
+    struct banks_bank banks[TILESET_MAX_BANKS];
+    struct banks_color missing[PALETTE_MAX_ENTRIES];
+    struct banks_tile *tiles;
+    uint32_t nr_banks = 0;
+    uint32_t nr_lossy = 0;
+
+    tiles = memory_realloc_array(NULL, tileset->nr_tiles, sizeof(struct banks_tile));
+    if (tiles == NULL)
+    {
+        return -1;
+    }
+
+    tileset->tile_banks = memory_alloc(tileset->nr_tiles);
+    if (tileset->tile_banks == NULL)
+    {
+        memory_free(tiles);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        const struct tileset_tile *tile = &tileset->tiles[i];
+
+        memset(tiles[i].counts, 0, sizeof tiles[i].counts);
+        tiles[i].nr_colors = 0;
+        tiles[i].index = i;
+
+        for (uint32_t j = 0; j < tile->data_size; ++j)
+        {
+            tiles[i].counts[tile->data[j]]++;
+        }
+
+        tiles[i].counts[transparent_index] = 0;
+
+        for (uint32_t j = 0; j < PALETTE_MAX_ENTRIES; ++j)
+        {
+            tiles[i].nr_colors += tiles[i].counts[j] != 0;
+        }
+    }
+
+    qsort(tiles, tileset->nr_tiles, sizeof(struct banks_tile), banks_tile_cmp);
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        const struct banks_tile *tile = &tiles[i];
+        uint32_t best = UINT32_MAX;
+        uint32_t best_missing = UINT32_MAX;
+        uint32_t nr_missing;
+
+        for (uint32_t b = 0; b < nr_banks; ++b)
+        {
+            nr_missing = banks_missing(&banks[b], tile, missing);
+
+            if (nr_missing <= TILESET_BANK_SIZE - banks[b].nr_colors &&
+                nr_missing < best_missing)
+            {
+                best = b;
+                best_missing = nr_missing;
+            }
+        }
+
+        if (best == UINT32_MAX && nr_banks < max_banks)
+        {
+            best = nr_banks++;
+            banks[best].colors[0] = transparent_index;
+            banks[best].nr_colors = BANKS_FIRST_COLOR;
+        }
+
+        if (best == UINT32_MAX)
+        {
+            uint64_t best_error = UINT64_MAX;
+
+            for (uint32_t b = 0; b < nr_banks; ++b)
+            {
+                uint64_t error;
+
+                nr_missing = banks_missing(&banks[b], tile, missing);
+                error = banks_error(&banks[b], palette, missing, nr_missing);
+                if (error < best_error)
+                {
+                    best = b;
+                    best_error = error;
+                }
+            }
+        }
+
+        nr_missing = banks_missing(&banks[best], tile, missing);
+        if (nr_missing > TILESET_BANK_SIZE - banks[best].nr_colors)
+        {
+            nr_lossy++;
+        }
+
+        banks_add(&banks[best], missing, nr_missing);
+        tileset->tile_banks[tile->index] = best;
+    }
+
+    memory_free(tiles);
+
+    for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
+    {
+        struct tileset_tile *tile = &tileset->tiles[i];
+        const struct banks_bank *bank = &banks[tileset->tile_banks[i]];
+        uint8_t map[PALETTE_MAX_ENTRIES];
+        bool mapped[PALETTE_MAX_ENTRIES];
+
+        memset(mapped, 0, sizeof mapped);
+
+        for (uint32_t j = 0; j < bank->nr_colors; ++j)
+        {
+            map[bank->colors[j]] = j;
+            mapped[bank->colors[j]] = true;
+        }
+
+        for (uint32_t j = 0; j < tile->data_size; ++j)
+        {
+            uint8_t index = tile->data[j];
+
+            if (!mapped[index])
+            {
+                map[index] = banks_nearest(bank, palette, index);
+                mapped[index] = true;
+            }
+
+            tile->data[j] = map[index];
+        }
+    }
+
+    memset(tileset->banks, transparent_index, sizeof tileset->banks);
+
+    for (uint32_t b = 0; b < nr_banks; ++b)
+    {
+        memcpy(&tileset->banks[b * TILESET_BANK_SIZE], banks[b].colors, banks[b].nr_colors);
+    }
+
+    tileset->nr_banks = nr_banks;
+
+    LOG_INFO(" - Packed %u tiles into %u palette banks (%u approximated)\n",
+        tileset->nr_tiles, nr_banks, nr_lossy);
+
+    return 0;
+}
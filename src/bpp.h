@@ -42,6 +42,7 @@ typedef enum
     BPP_4,
     BPP_8,
     BPP_16,
+    BPP_AUTO,
 } bpp_t;
 
 #ifdef __cplusplus
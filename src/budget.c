@@ -0,0 +1,430 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "budget.h"
+#include "convert.h"
+#include "image.h"
+#include "cost.h"
+#include "memory.h"
+#include "log.h"
+
+#include <string.h>
+
+/* rlet at 8 bpp, plus 8 bpp and the smallest packed mode, per codec */
+#define BUDGET_MAX_CANDIDATES 9
+
+struct budget_candidate
+{
+    struct convert_encoding encoding;
+    uint32_t size;
+    double cost;
+};
+
+struct budget_asset
+{
+    const struct convert *convert;
+    struct image *image;
+    struct budget_candidate candidates[BUDGET_MAX_CANDIDATES];
+    uint32_t nr_candidates;
+    uint32_t choice;
+};
+
+static const compress_mode_t budget_codecs[] =
+{
+    COMPRESS_NONE,
+    COMPRESS_ZX7,
+    COMPRESS_ZX0,
+};
+
+static const char *budget_codec_name(compress_mode_t mode)
+{
+    switch (mode)
+    {
+        case COMPRESS_ZX7:
+            return "zx7";
+        case COMPRESS_ZX0:
+            return "zx0";
+        default:
+            return "none";
+    }
+}
+
+/* encode a copy of the image indices to find the candidate size */
+static int budget_evaluate(struct budget_asset *asset, const struct convert_encoding *encoding)
+{
+    const struct convert *convert = asset->convert;
+    struct budget_candidate *candidate;
+    struct image scratch = *asset->image;
+    uint32_t nr_indices;
+    uint32_t cycles = 0;
+
+    nr_indices = scratch.width * scratch.height;
+
+    scratch.indices = NULL;
+    scratch.data = memory_alloc(nr_indices);
+    if (scratch.data == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(scratch.data, asset->image->indices, nr_indices);
+    scratch.data_size = nr_indices;
+
+    if (encoding->rlet)
+    {
+        struct image_rlet_stats stats;
+
+        image_rlet_stats(&scratch, convert->transparent_index, &stats);
+        cycles = cost_rlet_draw(scratch.height, &stats);
+    }
+
+    if (convert_encode_image(convert, &scratch, encoding))
+    {
+        memory_free(scratch.data);
+        return -1;
+    }
+
+    if (!encoding->rlet)
+    {
+        cycles = cost_sprite_draw(scratch.width, scratch.height, scratch.bpp);
+    }
+
+    cycles += cost_decompress(encoding->compress, scratch.uncompressed_size);
+
+    candidate = &asset->candidates[asset->nr_candidates];
+    candidate->encoding = *encoding;
+    candidate->size = scratch.data_size;
+    candidate->cost = (double)convert->decode_weight * cycles;
+    asset->nr_candidates++;
+
+    memory_free(scratch.data);
+
+    return 0;
+}
+
+static int budget_evaluate_asset(struct budget_asset *asset)
+{
+    struct image indices = *asset->image;
+    bpp_t packed_bpp;
+
+    indices.data = asset->image->indices;
+    indices.data_size = indices.width * indices.height;
+
+    /* packing is lossless only down to the number of used indices */
+    packed_bpp = image_min_bpp(&indices);
+
+    asset->nr_candidates = 0;
+
+    for (uint32_t i = 0; i < sizeof budget_codecs / sizeof budget_codecs[0]; ++i)
+    {
+        struct convert_encoding encoding;
+
+        encoding.compress = budget_codecs[i];
+        encoding.rlet = false;
+        encoding.bpp = BPP_8;
+
+        if (budget_evaluate(asset, &encoding))
+        {
+            return -1;
+        }
+
+        if (packed_bpp != BPP_8)
+        {
+            encoding.bpp = BPP_AUTO;
+
+            if (budget_evaluate(asset, &encoding))
+            {
+                return -1;
+            }
+        }
+
+        /* rlet has no pixel grid to lay out */
+        if (asset->convert->layout == IMAGE_LAYOUT_ROW_MAJOR)
+        {
+            encoding.rlet = true;
+            encoding.bpp = BPP_8;
+
+            if (budget_evaluate(asset, &encoding))
+            {
+                return -1;
+            }
+        }
+    }
+
+    /* start from the fastest candidate, preferring smaller on ties */
+    asset->choice = 0;
+    for (uint32_t i = 1; i < asset->nr_candidates; ++i)
+    {
+        const struct budget_candidate *candidate = &asset->candidates[i];
+        const struct budget_candidate *best = &asset->candidates[asset->choice];
+
+        if (candidate->cost < best->cost ||
+            (candidate->cost == best->cost && candidate->size < best->size))
+        {
+            asset->choice = i;
+        }
+    }
+
+    return 0;
+}
+
+/* bytes the solver cannot change: header, lut, palettes, tilesets, direct images */
+static uint32_t budget_fixed_size(const struct output *output, uint32_t *nr_assets)
+{
+    const struct appvar *appvar = &output->appvar;
+    uint32_t nr_entries = 0;
+    uint32_t size;
+
+    size = appvar->header_size;
+    *nr_assets = 0;
+
+    for (uint32_t i = 0; i < output->nr_palettes; ++i)
+    {
+        const struct palette *palette = output->palettes[i];
+
+        size += palette->nr_entries * 2 + palette_tables_size(palette);
+        if (output->palette_sizes)
+        {
+            size += 2;
+        }
+
+        nr_entries++;
+    }
+
+    for (uint32_t i = 0; i < output->nr_converts; ++i)
+    {
+        const struct convert *convert = output->converts[i];
+
+        for (uint32_t j = 0; j < convert->nr_images; ++j)
+        {
+            const struct image *image = &convert->images[j];
+
+            size += image->mask_size;
+
+            if (image->indices == NULL)
+            {
+                size += image->data_size;
+            }
+            else
+            {
+                *nr_assets = *nr_assets + 1;
+            }
+
+            nr_entries++;
+        }
+
+        for (uint32_t j = 0; j < convert->nr_tilesets; ++j)
+        {
+            const struct tileset *tileset = &convert->tilesets[j];
+
+            nr_entries++;
+
+            for (uint32_t k = 0; k < tileset->nr_tiles; ++k)
+            {
+                size += tileset->tiles[k].data_size;
+                nr_entries++;
+            }
+        }
+    }
+
+    if (appvar->lut)
+    {
+        /* + 1 for lut size */
+        size += (nr_entries + 1) * appvar->entry_size;
+    }
+
+    return size;
+}
+
+/* trade the least decode time per byte saved until the budget is met */
+static uint32_t budget_shrink(struct budget_asset *assets, uint32_t nr_assets, uint32_t size, uint32_t budget)
+{
+    while (size > budget)
+    {
+        struct budget_asset *best_asset = NULL;
+        uint32_t best_choice = 0;
+        double best_ratio = 0;
+
+        for (uint32_t i = 0; i < nr_assets; ++i)
+        {
+            struct budget_asset *asset = &assets[i];
+            const struct budget_candidate *current = &asset->candidates[asset->choice];
+
+            for (uint32_t j = 0; j < asset->nr_candidates; ++j)
+            {
+                const struct budget_candidate *candidate = &asset->candidates[j];
+                double ratio;
+
+                if (candidate->size >= current->size)
+                {
+                    continue;
+                }
+
+                ratio = (candidate->cost - current->cost) /
+                        (double)(current->size - candidate->size);
+
+                if (best_asset == NULL || ratio < best_ratio)
+                {
+                    best_asset = asset;
+                    best_choice = j;
+                    best_ratio = ratio;
+                }
+            }
+        }
+
+        /* every asset is already at its smallest encoding */
+        if (best_asset == NULL)
+        {
+            break;
+        }
+
+        size -= best_asset->candidates[best_asset->choice].size;
+        size += best_asset->candidates[best_choice].size;
+        best_asset->choice = best_choice;
+    }
+
+    return size;
+}
+
+static int budget_apply(struct budget_asset *asset)
+{
+    const struct budget_candidate *candidate = &asset->candidates[asset->choice];
+    struct image *image = asset->image;
+    uint32_t nr_indices = image->width * image->height;
+
+    memory_free(image->data);
+    image->data = memory_alloc(nr_indices);
+    if (image->data == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(image->data, image->indices, nr_indices);
+    image->data_size = nr_indices;
+
+    if (convert_encode_image(asset->convert, image, &candidate->encoding))
+    {
+        return -1;
+    }
+
+    image->auto_encoded = true;
+    image->auto_bpp = true;
+
+    LOG_INFO(" - \'%s\': %s, %u bpp, compress %s, %u bytes\n",
+        image->name,
+        image->rlet ? "rlet" : "palette",
+        image_bpp_bits(image->bpp),
+        budget_codec_name(image->compress),
+        image->data_size);
+
+    return 0;
+}
+
+int budget_solve(struct output *output)
+{
+    struct appvar *appvar = &output->appvar;
+    struct budget_asset *assets = NULL;
+    uint32_t nr_assets;
+    uint32_t index;
+    uint32_t size;
+    int ret = -1;
+
+    LOG_INFO("Solving budget for AppVar \'%s\'\n", appvar->name);
+
+    size = budget_fixed_size(output, &nr_assets);
+
+    if (nr_assets != 0)
+    {
+        assets = memory_realloc_array(NULL, nr_assets, sizeof(struct budget_asset));
+        if (assets == NULL)
+        {
+            return -1;
+        }
+    }
+
+    index = 0;
+
+    for (uint32_t i = 0; i < output->nr_converts; ++i)
+    {
+        const struct convert *convert = output->converts[i];
+
+        for (uint32_t j = 0; j < convert->nr_images; ++j)
+        {
+            struct image *image = &convert->images[j];
+            struct budget_asset *asset;
+
+            if (image->indices == NULL)
+            {
+                continue;
+            }
+
+            asset = &assets[index];
+            asset->convert = convert;
+            asset->image = image;
+
+            if (budget_evaluate_asset(asset))
+            {
+                goto error;
+            }
+
+            size += asset->candidates[asset->choice].size;
+            index++;
+        }
+    }
+
+    size = budget_shrink(assets, nr_assets, size, appvar->budget);
+    if (size > appvar->budget)
+    {
+        LOG_ERROR("AppVar \'%s\' cannot fit in a budget of %u bytes "
+                  "(smallest is %u bytes).\n",
+            appvar->name,
+            appvar->budget,
+            size);
+        goto error;
+    }
+
+    for (uint32_t i = 0; i < nr_assets; ++i)
+    {
+        if (budget_apply(&assets[i]))
+        {
+            goto error;
+        }
+    }
+
+    LOG_INFO(" - Using %u of %u budgeted bytes\n",
+        size,
+        appvar->budget);
+
+    ret = 0;
+
+error:
+    memory_free(assets);
+    return ret;
+}
@@ -30,6 +30,8 @@
 
 #include "clean.h"
 #include "strings.h"
+#include "stats.h"
+#include "memory.h"
 #include "log.h"
 
 #include <errno.h>
@@ -87,6 +89,11 @@ FILE *clean_fopen(const char *path, const char *mode)
 {
     clean_add_path(path);
 
+    if (mode[0] == 'w')
+    {
+        stats_file(path);
+    }
+
     return fopen(path, mode);
 }
 
@@ -133,12 +140,12 @@ create:
         clean.fd = fd;
     }
 
-    free(name);
+    memory_free(name);
 
     return 0;
 
 error:
-    free(name);
+    memory_free(name);
     return -1;
 }
 
@@ -29,13 +29,32 @@
  */
 
 #include "compress.h"
+#include "profile.h"
+#include "stats.h"
+#include "memory.h"
 #include "log.h"
 
 #include "deps/zx/zx7/zx7.h"
 #include "deps/zx/zx0/zx0.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+/* the compressors allocate with the C library, so copy into tracked memory */
+static uint8_t *compress_adopt(uint8_t *data, size_t size)
+{
+    uint8_t *copy = memory_alloc(size);
+
+    if (copy != NULL)
+    {
+        memcpy(copy, data, size);
+    }
+
+    free(data);
+
+    return copy;
+}
+
 static uint8_t *compress_zx7(uint8_t *data, size_t *size)
 {
     zx7_Optimal *opt;
@@ -67,7 +86,7 @@ static uint8_t *compress_zx7(uint8_t *data, size_t *size)
 
     *size = new_size;
 
-    return compressed_data;
+    return compress_adopt(compressed_data, new_size);
 }
 
 static void compress_zx0_progress(void)
@@ -114,18 +133,49 @@ static uint8_t *compress_zx0(uint8_t *data, size_t *size)
 
     zx0_free();
 
-    return compressed_data;
+    return compress_adopt(compressed_data, new_size);
 }
 
 uint8_t *compress_array(uint8_t *data, size_t *size, compress_mode_t mode)
 {
+    uint8_t *compressed;
+    memory_tag_t tag;
+    uint64_t start;
+    size_t orig_size;
+
+    if (size == NULL)
+    {
+        return NULL;
+    }
+
+    start = profile_now();
+    orig_size = *size;
+
     switch (mode)
     {
         case COMPRESS_ZX7:
-            return compress_zx7(data, size);
+            profile_begin("compress", "zx7");
+            tag = memory_set_tag(MEMORY_TAG_COMPRESS);
+            compressed = compress_zx7(data, size);
+            memory_set_tag(tag);
+            profile_end("compress", "zx7");
+            if (compressed != NULL)
+            {
+                stats_stage("zx7", orig_size, *size, profile_now() - start);
+            }
+            return compressed;
 
         case COMPRESS_ZX0:
-            return compress_zx0(data, size);
+            profile_begin("compress", "zx0");
+            tag = memory_set_tag(MEMORY_TAG_COMPRESS);
+            compressed = compress_zx0(data, size);
+            memory_set_tag(tag);
+            profile_end("compress", "zx0");
+            if (compressed != NULL)
+            {
+                stats_stage("zx0", orig_size, *size, profile_now() - start);
+            }
+            return compressed;
 
         default:
             return NULL;
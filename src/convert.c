@@ -29,13 +29,18 @@
  */
 
 #include "convert.h"
+#include "banks.h"
+#include "cost.h"
 #include "strings.h"
 #include "compress.h"
 #include "memory.h"
 #include "tileset.h"
+#include "profile.h"
+#include "stats.h"
 #include "log.h"
 #include "image.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <glob.h>
 
@@ -49,10 +54,12 @@ struct convert *convert_alloc(void)
 
     convert->images = NULL;
     convert->nr_images = 0;
+    convert->nr_images_alloc = 0;
     convert->compress = COMPRESS_NONE;
     convert->palette = NULL;
     convert->palette_offset = 0;
     convert->style = CONVERT_STYLE_PALETTE;
+    convert->style_objective = CONVERT_OBJECTIVE_SIZE;
     convert->nr_omit_indices = 0;
     convert->add_width_height = true;
     convert->transparent_index = 0;
@@ -65,21 +72,53 @@ struct convert *convert_alloc(void)
     convert->rotate = 0;
     convert->flip_x = false;
     convert->flip_y = false;
+    convert->trim = false;
+    convert->preshift = false;
+    convert->nr_variants = 0;
+    convert->nr_rotations = 0;
+    convert->nr_scales = 0;
+    convert->masks = false;
+    convert->layout = IMAGE_LAYOUT_ROW_MAJOR;
+    convert->layout_stride = 0;
+    convert->animation = CONVERT_ANIMATION_NONE;
+    convert->palette_banks = 0;
+    convert->scale_filter = IMAGE_SCALE_BOX;
     convert->tilesets = NULL;
     convert->nr_tilesets = 0;
+    convert->nr_tilesets_alloc = 0;
     convert->tile_height = 0;
     convert->tile_width = 0;
     convert->tile_rotate = 0;
     convert->tile_flip_x = false;
     convert->tile_flip_y = false;
     convert->p_table = true;
+    convert->decode_weight = 1;
+    convert->keep_indices = false;
 
     return convert;
 }
 
 static bool convert_is_palette_style(const struct convert *convert)
 {
-    return convert->style == CONVERT_STYLE_PALETTE || convert->style == CONVERT_STYLE_RLET;
+    return convert->style == CONVERT_STYLE_PALETTE ||
+           convert->style == CONVERT_STYLE_RLET ||
+           convert->style == CONVERT_STYLE_AUTO ||
+           convert->style == CONVERT_STYLE_COMPILED;
+}
+
+static uint32_t convert_pixels_per_byte(const struct convert *convert)
+{
+    switch (convert->bpp)
+    {
+        case BPP_1:
+            return 8;
+        case BPP_2:
+            return 4;
+        case BPP_4:
+            return 2;
+        default:
+            return 1;
+    }
 }
 
 static int convert_add_image(struct convert *convert, const char *path)
@@ -91,7 +130,7 @@ static int convert_add_image(struct convert *convert, const char *path)
         return -1;
     }
 
-    convert->images = memory_realloc_array(convert->images, convert->nr_images + 1, sizeof(struct image));
+    convert->images = memory_grow_array(convert->images, &convert->nr_images_alloc, convert->nr_images, sizeof(struct image));
     if (convert->images == NULL)
     {
         return -1;
@@ -119,7 +158,7 @@ static int convert_add_tileset(struct convert *convert, const char *path)
         return -1;
     }
 
-    convert->tilesets = memory_realloc_array(convert->tilesets, convert->nr_tilesets + 1, sizeof(struct tileset));
+    convert->tilesets = memory_grow_array(convert->tilesets, &convert->nr_tilesets_alloc, convert->nr_tilesets, sizeof(struct tileset));
     if (convert->tilesets == NULL)
     {
         return -1;
@@ -130,18 +169,13 @@ static int convert_add_tileset(struct convert *convert, const char *path)
 
     tileset->tiles = NULL;
     tileset->nr_tiles = 0;
+    tileset->delta = false;
+    tileset->nr_banks = 0;
+    tileset->tile_banks = NULL;
 
     image = &tileset->image;
-    image->path = strings_dup(path);
-    image->name = strings_basename(path);
-    image->data = NULL;
-    image->width = 0;
-    image->height = 0;
-    image->compressed = false;
-    image->rlet = false;
-    image->rotate = 0;
-    image->flip_x = false;
-    image->flip_y = false;
+
+    image_init(image, path);
 
     return 0;
 }
@@ -171,7 +205,7 @@ int convert_add_image_path(struct convert *convert, const char *path)
     {
         LOG_ERROR("Could not find file(s): \'%s\'\n", realPath);
         globfree(&globbuf);
-        free(realPath);
+        memory_free(realPath);
         return -1;
     }
 
@@ -181,7 +215,7 @@ int convert_add_image_path(struct convert *convert, const char *path)
     }
 
     globfree(&globbuf);
-    free(realPath);
+    memory_free(realPath);
 
     return 0;
 }
@@ -211,7 +245,7 @@ int convert_add_tileset_path(struct convert *convert, const char *path)
     {
         LOG_ERROR("Could not find file(s): \'%s\'\n", real_path);
         globfree(&globbuf);
-        free(real_path);
+        memory_free(real_path);
         return -1;
     }
 
@@ -221,18 +255,13 @@ int convert_add_tileset_path(struct convert *convert, const char *path)
     }
 
     globfree(&globbuf);
-    free(real_path);
+    memory_free(real_path);
 
     return 0;
 }
 
-void convert_free(struct convert *convert)
+void convert_release(struct convert *convert)
 {
-    if (convert == NULL)
-    {
-        return;
-    }
-
     for (uint32_t i = 0; i < convert->nr_images; ++i)
     {
         image_free(&convert->images[i]);
@@ -245,30 +274,46 @@ void convert_free(struct convert *convert)
     }
     convert->nr_tilesets = 0;
 
-    free(convert->images);
+    memory_free(convert->tilesets);
+    convert->tilesets = NULL;
+    convert->nr_tilesets_alloc = 0;
+}
+
+void convert_free(struct convert *convert)
+{
+    if (convert == NULL)
+    {
+        return;
+    }
+
+    convert_release(convert);
+
+    memory_free(convert->images);
     convert->images = NULL;
+    convert->nr_images_alloc = 0;
 
-    free(convert->name);
+    memory_free(convert->name);
     convert->name = NULL;
 
-    free(convert->palette_name);
+    memory_free(convert->palette_name);
     convert->palette_name = NULL;
 }
 
-static int convert_find_palette(struct convert *convert, struct palette **palettes, uint32_t nr_palettes)
+static int convert_find_palette(struct convert *convert,
+    struct palette **palettes,
+    const struct registry *palette_registry)
 {
+    uint32_t index;
+
     if (palettes == NULL || convert->palette_name == NULL)
     {
         goto error;
     }
 
-    for (uint32_t i = 0; i < nr_palettes; ++i)
+    if (!registry_find(palette_registry, convert->palette_name, &index))
     {
-        if (!strcmp(convert->palette_name, palettes[i]->name))
-        {
-            convert->palette = palettes[i];
-            return 0;
-        }
+        convert->palette = palettes[index];
+        return 0;
     }
 
 error:
@@ -279,65 +324,166 @@ error:
     return -1;
 }
 
-static int convert_image(struct convert *convert, struct image *image)
+static bool convert_select_rlet(const struct convert *convert, const struct image *image)
 {
-    if (convert_is_palette_style(convert))
+    struct image_rlet_stats stats;
+    bpp_t bpp = image->bpp;
+    uint32_t normal_size;
+    uint32_t normal_cycles;
+    uint32_t rlet_cycles;
+
+    /* rlet data is never packed */
+    if (bpp != BPP_8 && bpp != BPP_AUTO)
     {
-        if (image_quantize(image, convert->palette))
+        return false;
+    }
+
+    if (bpp == BPP_AUTO)
+    {
+        bpp = image_min_bpp(image);
+    }
+
+    image_rlet_stats(image, convert->transparent_index, &stats);
+
+    normal_size = (image->width * image->height * image_bpp_bits(bpp)) / 8;
+    normal_cycles = cost_sprite_draw(image->width, image->height, bpp);
+    rlet_cycles = cost_rlet_draw(image->height, &stats);
+
+    LOG_DEBUG("Style sizes for \'%s\': palette %u (%u cycles), rlet %u (%u cycles)\n",
+        image->name, normal_size, normal_cycles, stats.size, rlet_cycles);
+
+    if (convert->style_objective == CONVERT_OBJECTIVE_SPEED)
+    {
+        if (rlet_cycles != normal_cycles)
         {
-            return -1;
+            return rlet_cycles < normal_cycles;
         }
 
-        if (convert->palette_offset != 0)
+        return stats.size < normal_size;
+    }
+
+    if (stats.size != normal_size)
+    {
+        return stats.size < normal_size;
+    }
+
+    return rlet_cycles < normal_cycles;
+}
+
+/* counts an encoding step that started at start with bytes_in of data */
+static void convert_stage(const char *stage, const struct image *image, size_t bytes_in, uint64_t start)
+{
+    stats_stage(stage, bytes_in, image->data_size, profile_now() - start);
+}
+
+int convert_encode_image(const struct convert *convert, struct image *image, const struct convert_encoding *encoding)
+{
+    uint64_t start;
+    size_t bytes_in;
+
+    image->rlet = encoding->rlet;
+    image->bpp = encoding->bpp;
+    image->compress = encoding->compress;
+    image->nr_sub_palette_entries = 0;
+    image->nr_shifts = 0;
+    image->layout = IMAGE_LAYOUT_ROW_MAJOR;
+    image->stride = 0;
+
+    if (convert_is_palette_style(convert))
+    {
+        if (image->compiled)
         {
-            if (convert->palette_offset + convert->palette->nr_entries >=
-                PALETTE_MAX_ENTRIES)
-            {
-                LOG_ERROR("Palette offset places indices out of range for "
-                        "convert \'%s\'\n",
-                    convert->name);
-                return -1;
-            }
+            struct image_rlet_stats stats;
 
-            if (image_add_offset(image, convert->palette_offset))
+            image_rlet_stats(image, convert->transparent_index, &stats);
+
+            start = profile_now();
+            bytes_in = image->data_size;
+            if (image_compile(image, convert->transparent_index))
             {
                 return -1;
             }
-        }
+            convert_stage("compiled", image, bytes_in, start);
 
-        if (convert->style == CONVERT_STYLE_RLET)
+            LOG_INFO(" - Compiled \'%s\': %u bytes (rlet is %u bytes)\n",
+                image->name,
+                image->data_size,
+                stats.size + WIDTH_HEIGHT_SIZE);
+        }
+        else if (image->rlet)
         {
+            start = profile_now();
+            bytes_in = image->data_size;
             if (image_rlet(image, convert->transparent_index))
             {
                 return -1;
             }
+            convert_stage("rlet", image, bytes_in, start);
+
+            /* rlet data has no pixel grid to pack */
+            if (image->bpp == BPP_AUTO)
+            {
+                image->bpp = BPP_8;
+            }
         }
 
         if (convert->nr_omit_indices)
         {
+            start = profile_now();
+            bytes_in = image->data_size;
             if (image_remove_omits(image, convert->omit_indices, convert->nr_omit_indices))
             {
                 return -1;
             }
+            convert_stage("omit", image, bytes_in, start);
         }
 
-        if (convert->bpp != BPP_8)
+        start = profile_now();
+        bytes_in = image->data_size;
+        if (image->bpp == BPP_AUTO)
+        {
+            if (image_auto_bpp(image))
+            {
+                return -1;
+            }
+            convert_stage("bpp", image, bytes_in, start);
+        }
+        else if (image->bpp != BPP_8 && image->preshift)
+        {
+            if (image_preshift(image, image->bpp, convert->palette->nr_entries, convert->transparent_index))
+            {
+                return -1;
+            }
+            convert_stage("preshift", image, bytes_in, start);
+        }
+        else if (image->bpp != BPP_8)
         {
-            if (image_set_bpp(image, convert->bpp, convert->palette->nr_entries))
+            /* banked tiles index their bank rather than the palette */
+            uint32_t nr_entries = convert->palette_banks ?
+                TILESET_BANK_SIZE : convert->palette->nr_entries;
+
+            if (image_set_bpp(image, image->bpp, nr_entries))
             {
                 return -1;
             }
+            convert_stage("bpp", image, bytes_in, start);
         }
     }
-    else
+
+    /* reorder the packed pixel grid for custom blitters */
+    if (convert->layout != IMAGE_LAYOUT_ROW_MAJOR)
     {
-        if (image_direct_convert(image, convert->color_fmt))
+        start = profile_now();
+        bytes_in = image->data_size;
+        if (image_set_layout(image, convert->layout, convert->layout_stride))
         {
             return -1;
         }
+        convert_stage("layout", image, bytes_in, start);
     }
 
-    if (convert->add_width_height == true)
+    /* compiled sprites are code, so nothing is placed in front */
+    if (convert->add_width_height == true && !image->compiled)
     {
         if (image_add_width_and_height(image))
         {
@@ -345,11 +491,15 @@ static int convert_image(struct convert *convert, struct image *image)
         }
     }
 
+    image->gfx = (image->rlet || convert->add_width_height) && image->bpp == BPP_8 && !image->compiled &&
+        image->layout == IMAGE_LAYOUT_ROW_MAJOR;
+
     image->uncompressed_size = image->data_size;
 
-    if (convert->compress != COMPRESS_NONE)
+    image->compressed = false;
+    if (image->compress != COMPRESS_NONE)
     {
-        if (image_compress(image, convert->compress))
+        if (image_compress(image, image->compress))
         {
             return -1;
         }
@@ -360,8 +510,193 @@ static int convert_image(struct convert *convert, struct image *image)
     return 0;
 }
 
+static int convert_quantize_image(struct convert *convert, struct image *image)
+{
+    memory_tag_t tag;
+    int ret;
+
+    if (!convert_is_palette_style(convert))
+    {
+        return 0;
+    }
+
+    profile_begin("quantize", image->name);
+    tag = memory_set_tag(MEMORY_TAG_QUANTIZE);
+    ret = image_quantize(image, convert->palette);
+    memory_set_tag(tag);
+    profile_end("quantize", image->name);
+    if (ret)
+    {
+        return -1;
+    }
+
+    if (convert->palette_offset != 0)
+    {
+        if (convert->palette_offset + convert->palette->nr_entries >=
+            PALETTE_MAX_ENTRIES)
+        {
+            LOG_ERROR("Palette offset places indices out of range for "
+                    "convert \'%s\'\n",
+                convert->name);
+            return -1;
+        }
+
+        if (image_add_offset(image, convert->palette_offset))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int convert_image_in_scratch(struct convert *convert, struct image *image)
+{
+    struct convert_encoding encoding;
+    memory_tag_t tag;
+    int ret;
+
+    if (image->masked)
+    {
+        if (image_build_mask(image, !convert_is_palette_style(convert), convert->transparent_index))
+        {
+            return -1;
+        }
+
+        if (convert->compress != COMPRESS_NONE)
+        {
+            size_t size = image->mask_size;
+            uint8_t *mask = compress_array(image->mask, &size, convert->compress);
+
+            memory_free(image->mask);
+            image->mask = mask;
+            if (mask == NULL)
+            {
+                return -1;
+            }
+
+            image->mask_size = size;
+            image->mask_compressed = true;
+        }
+    }
+
+    if (convert_is_palette_style(convert))
+    {
+        /* a budget may need to encode the indices again */
+        if (image->keep_indices)
+        {
+            image->indices = memory_alloc(image->data_size);
+            if (image->indices == NULL)
+            {
+                return -1;
+            }
+
+            memcpy(image->indices, image->data, image->data_size);
+        }
+
+        if (image->auto_rlet)
+        {
+            image->rlet = convert_select_rlet(convert, image);
+        }
+    }
+    else
+    {
+        uint64_t start = profile_now();
+        size_t bytes_in = (size_t)image->width * image->height * 4;
+
+        if (image_direct_convert(image, convert->color_fmt))
+        {
+            return -1;
+        }
+        convert_stage("direct", image, bytes_in, start);
+    }
+
+    encoding.rlet = image->rlet;
+    encoding.bpp = image->bpp;
+    encoding.compress = convert->compress;
+
+    profile_begin("encode", image->name);
+    tag = memory_set_tag(MEMORY_TAG_ENCODE);
+    ret = convert_encode_image(convert, image, &encoding);
+    memory_set_tag(tag);
+    profile_end("encode", image->name);
+
+    return ret;
+}
+
+/* intermediate buffers come from scratch, only the encoded bytes are kept */
+static int convert_image(struct convert *convert, struct image *image)
+{
+    size_t mark;
+    int ret;
+
+    mark = memory_scratch_mark();
+
+    ret = convert_image_in_scratch(convert, image);
+
+    image->data = memory_persist(image->data, image->data_size);
+    image->mask = memory_persist(image->mask, image->mask_size);
+    if (image->data == NULL || (image->masked && image->mask == NULL))
+    {
+        ret = -1;
+    }
+
+    memory_scratch_release(mark);
+
+    return ret;
+}
+
+static bpp_t convert_tileset_bpp(const struct convert *convert, const struct tileset *tileset)
+{
+    uint32_t nr_indices;
+    uint32_t width;
+
+    if (convert->palette_banks)
+    {
+        return BPP_4;
+    }
+
+    if (convert->bpp != BPP_AUTO)
+    {
+        return convert->bpp;
+    }
+
+    if (convert->style == CONVERT_STYLE_RLET)
+    {
+        return BPP_8;
+    }
+
+    /* tiles share a pointer table, so pick one mode that fits the palette */
+    nr_indices = convert->palette_offset + convert->palette->nr_entries;
+
+    width = tileset->tile_width;
+    if (tileset->tile_rotate == 90 || tileset->tile_rotate == 270)
+    {
+        width = tileset->tile_height;
+    }
+
+    if (nr_indices <= 2 && width % 8 == 0)
+    {
+        return BPP_1;
+    }
+
+    if (nr_indices <= 4 && width % 4 == 0)
+    {
+        return BPP_2;
+    }
+
+    if (nr_indices <= 16 && width % 2 == 0)
+    {
+        return BPP_4;
+    }
+
+    return BPP_8;
+}
+
 static int convert_tileset(struct convert *convert, struct tileset *tileset)
 {
+    uint32_t tile_width = 0;
+    uint32_t tile_height = 0;
     uint32_t nr_tiles;
     uint32_t x;
     uint32_t y;
@@ -401,6 +736,7 @@ static int convert_tileset(struct convert *convert, struct tileset *tileset)
         uint32_t image_stride = tileset->image.width * sizeof(uint32_t);
         void *tile_data;
         uint8_t *dst;
+        size_t mark;
 
         tile_data = memory_alloc(tile_data_size);
         if (tile_data == NULL)
@@ -416,6 +752,8 @@ static int convert_tileset(struct convert *convert, struct tileset *tileset)
             .height = tileset->tile_height,
             .name = NULL,
             .path = NULL,
+            .bpp = tileset->image.bpp,
+            .rlet = tileset->rlet,
         };
 
         dst = tile_data;
@@ -479,34 +817,329 @@ static int convert_tileset(struct convert *convert, struct tileset *tileset)
             y += tileset->tile_height * image_stride;
         }
 
-        if (convert_image(convert, &tile))
+        mark = memory_scratch_mark();
+
+        if (convert_quantize_image(convert, &tile))
+        {
+            goto scratch_error;
+        }
+
+        /* banked tiles are encoded once every tile is assigned a bank */
+        if (convert->palette_banks)
+        {
+            tile.data = memory_persist(tile.data, tile.data_size);
+            if (tile.data == NULL)
+            {
+                memory_scratch_release(mark);
+                return -1;
+            }
+        }
+        else if (convert_image(convert, &tile))
         {
+scratch_error:
+            tile.data = memory_persist(tile.data, tile.data_size);
+            memory_scratch_release(mark);
 error:
-            free(tile.data);
+            memory_free(tile.data);
             return -1;
         }
 
+        memory_scratch_release(mark);
+
         tileset->tiles[i].data_size = tile.data_size;
         tileset->tiles[i].data = tile.data;
+        tileset->image.layout = tile.layout;
+        tileset->image.stride = tile.stride;
+        tile_width = tile.width;
+        tile_height = tile.height;
+    }
+
+    if (convert->palette_banks)
+    {
+        if (banks_generate(tileset, convert->palette, convert->palette_banks, convert->transparent_index))
+        {
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < nr_tiles; ++i)
+        {
+            struct image tile =
+            {
+                .data = tileset->tiles[i].data,
+                .data_size = tileset->tiles[i].data_size,
+                .width = tile_width,
+                .height = tile_height,
+                .name = NULL,
+                .path = NULL,
+                .bpp = tileset->image.bpp,
+                .rlet = false,
+            };
+
+            tileset->tiles[i].data = NULL;
+
+            if (convert_image(convert, &tile))
+            {
+                memory_free(tile.data);
+                return -1;
+            }
+
+            tileset->tiles[i].data_size = tile.data_size;
+            tileset->tiles[i].data = tile.data;
+            tileset->image.layout = tile.layout;
+            tileset->image.stride = tile.stride;
+        }
     }
 
     return 0;
 }
 
-int convert_generate(struct convert *convert, struct palette **palettes, uint32_t nr_palettes)
+static int convert_load_image(struct convert *convert, struct image *image)
 {
-    if (convert->nr_images == 0 && convert->nr_tilesets == 0)
+    /* assign image constants from convert */
+    image->quantize_speed = convert->quantize_speed;
+    image->dither = convert->dither;
+    image->rotate = convert->rotate;
+    image->flip_x = convert->flip_x;
+    image->flip_y = convert->flip_y;
+    image->transparent_index = convert->transparent_index;
+    image->rlet = convert->style == CONVERT_STYLE_RLET;
+    image->auto_rlet = convert->style == CONVERT_STYLE_AUTO;
+    image->compiled = convert->style == CONVERT_STYLE_COMPILED;
+    image->preshift = convert->preshift;
+    image->bpp = convert->bpp;
+    image->auto_bpp = convert->bpp == BPP_AUTO;
+    image->keep_indices = convert->keep_indices;
+    image->masked = convert->masks;
+
+    LOG_INFO(" - Reading image \'%s\'\n", image->path);
+
+    if (image_load(image))
     {
-        LOG_WARNING("No images or tilesets in convert \'%s\'\n",
-            convert->name);
+        return -1;
+    }
+
+    if (convert->trim)
+    {
+        if (image_trim(image, convert_pixels_per_byte(convert)))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int convert_check_dimensions(const struct convert *convert, const struct image *image)
+{
+    /* compiled sprites are code, so they carry no width and height */
+    if (convert->add_width_height && convert->style != CONVERT_STYLE_COMPILED)
+    {
+        if (image->width > 255)
+        {
+            LOG_ERROR("Image width is %u. "
+                "Maximum width is 255 when using the option \'width-and-height\'.\n",
+                image->width);
+            return -1;
+        }
+
+        if (image->height > 255)
+        {
+            LOG_ERROR("Image height is %u. "
+                "Maximum height is 255 when using the option \'width-and-height\'.\n",
+                image->height);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static const char *convert_variant_suffix(image_transform_t transform)
+{
+    switch (transform)
+    {
+        case IMAGE_TRANSFORM_FLIP_X:
+            return "flip_x";
+        case IMAGE_TRANSFORM_FLIP_Y:
+            return "flip_y";
+        case IMAGE_TRANSFORM_ROT_90:
+            return "rot90";
+        case IMAGE_TRANSFORM_ROT_180:
+            return "rot180";
+        case IMAGE_TRANSFORM_ROT_270:
+            return "rot270";
+        case IMAGE_TRANSFORM_TRANSPOSE:
+            return "transpose";
+        case IMAGE_TRANSFORM_TRANSVERSE:
+            return "transverse";
+        default:
+            return NULL;
+    }
+}
+
+/* derive a variant from the already quantized (or loaded) source pixels */
+static int convert_image_variant(struct convert *convert, const struct image *source,
+    struct image *image, image_transform_t transform)
+{
+    uint32_t pixel_size = convert_is_palette_style(convert) ? 1 : 4;
+    const char *suffix = convert_variant_suffix(transform);
+
+    *image = *source;
+    image->data = NULL;
+    image->indices = NULL;
+
+    image->name = suffix == NULL ?
+        strings_dup(source->name) :
+        strings_concat(source->name, "_", suffix, 0);
+    image->path = strings_dup(source->path);
+    if (image->name == NULL || image->path == NULL)
+    {
+        return -1;
+    }
+
+    image->data = memory_realloc_array(NULL, source->width * source->height, pixel_size);
+    if (image->data == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(image->data, source->data, source->width * source->height * pixel_size);
+
+    if (image_transform(image, transform, pixel_size))
+    {
+        return -1;
+    }
+
+    if (convert_check_dimensions(convert, image))
+    {
+        return -1;
+    }
+
+    return convert_image(convert, image);
+}
+
+/* resample the loaded pixels before quantization, e.g. 'image_x0_5' for 0.5 */
+static int convert_image_scale(struct convert *convert, const struct image *source,
+    struct image *image, float scale)
+{
+    uint32_t width = (uint32_t)((source->width * scale) + 0.5f);
+    uint32_t height = (uint32_t)((source->height * scale) + 0.5f);
+    char suffix[32];
+
+    *image = *source;
+    image->data = NULL;
+    image->indices = NULL;
+    image->name = NULL;
+    image->path = NULL;
+
+    if (width == 0 || height == 0)
+    {
+        LOG_ERROR("Image \'%s\' is empty at scale %g.\n", source->name, scale);
+        return -1;
+    }
+
+    if (scale == 1.0f)
+    {
+        image->name = strings_dup(source->name);
+    }
+    else
+    {
+        snprintf(suffix, sizeof suffix, "x%g", scale);
+        for (char *c = suffix; *c != '\0'; ++c)
+        {
+            if (*c == '.')
+            {
+                *c = '_';
+            }
+        }
+        image->name = strings_concat(source->name, "_", suffix, 0);
+    }
+    image->path = strings_dup(source->path);
+    if (image->name == NULL || image->path == NULL)
+    {
+        return -1;
+    }
+
+    image->data = memory_realloc_array(NULL, source->width * source->height, 4);
+    if (image->data == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(image->data, source->data, source->width * source->height * 4);
+
+    if (image_scale(image, width, height, convert->scale_filter))
+    {
+        return -1;
+    }
+
+    image->trim_x = (uint32_t)((source->trim_x * scale) + 0.5f);
+    image->trim_y = (uint32_t)((source->trim_y * scale) + 0.5f);
+    image->orig_width = (uint32_t)((source->orig_width * scale) + 0.5f);
+    image->orig_height = (uint32_t)((source->orig_height * scale) + 0.5f);
+
+    return 0;
+}
+
+/* quantize a loaded image and convert it, or each of its variants, into images */
+static int convert_image_outputs(struct convert *convert, struct image *source,
+    struct image *images, uint32_t *nr_images)
+{
+    if (convert->nr_variants == 0)
+    {
+        if (convert_check_dimensions(convert, source) ||
+            convert_quantize_image(convert, source) ||
+            convert_image(convert, source))
+        {
+            return -1;
+        }
+
+        /* the output takes over the source */
+        images[*nr_images] = *source;
+        (*nr_images)++;
+        source->name = NULL;
+        source->path = NULL;
+        source->data = NULL;
+        source->indices = NULL;
         return 0;
     }
 
-    LOG_INFO("Generating convert \'%s\'\n", convert->name);
+    /* decode and quantize once, then derive each variant */
+    if (convert_quantize_image(convert, source))
+    {
+        return -1;
+    }
 
-    if (convert_is_palette_style(convert))
+    for (uint32_t j = 0; j < convert->nr_variants; ++j)
     {
-        if (convert_find_palette(convert, palettes, nr_palettes))
+        struct image *variant = &images[*nr_images];
+
+        (*nr_images)++;
+
+        if (convert_image_variant(convert, source, variant, convert->variants[j]))
+        {
+            return -1;
+        }
+    }
+
+    memory_free(source->data);
+    source->data = NULL;
+
+    return 0;
+}
+
+static int convert_images(struct convert *convert)
+{
+    struct image *outputs = NULL;
+    uint32_t nr_outputs = 0;
+
+    if (convert->nr_variants != 0 || convert->nr_scales != 0)
+    {
+        uint32_t nr_variants = convert->nr_variants ? convert->nr_variants : 1;
+        uint32_t nr_scales = convert->nr_scales ? convert->nr_scales : 1;
+
+        outputs = memory_realloc_array(NULL, convert->nr_images * nr_scales * nr_variants, sizeof(struct image));
+        if (outputs == NULL)
         {
             return -1;
         }
@@ -516,48 +1149,344 @@ int convert_generate(struct convert *convert, struct palette **palettes, uint32_
     {
         struct image *image = &convert->images[i];
 
-        /* assign image constants from convert */
-        image->quantize_speed = convert->quantize_speed;
-        image->dither = convert->dither;
-        image->rotate = convert->rotate;
-        image->flip_x = convert->flip_x;
-        image->flip_y = convert->flip_y;
-        image->transparent_index = convert->transparent_index;
-        image->rlet = convert->style == CONVERT_STYLE_RLET;
+        if (convert_load_image(convert, image))
+        {
+            goto error;
+        }
 
-        image->gfx = false;
-        if ((image->rlet || convert->add_width_height) && convert->bpp == BPP_8)
+        if (outputs == NULL)
         {
-            image->gfx = true;
+            size_t mark = memory_scratch_mark();
+
+            if (convert_check_dimensions(convert, image) ||
+                convert_quantize_image(convert, image) ||
+                convert_image(convert, image))
+            {
+                image->data = memory_persist(image->data, image->data_size);
+                memory_scratch_release(mark);
+                goto error;
+            }
+
+            memory_scratch_release(mark);
+            continue;
+        }
+
+        if (convert->nr_scales == 0)
+        {
+            if (convert_image_outputs(convert, image, outputs, &nr_outputs))
+            {
+                goto error;
+            }
+            continue;
         }
 
-        LOG_INFO(" - Reading image \'%s\'\n", image->path);
+        /* decode once, then resample for each scale */
+        for (uint32_t j = 0; j < convert->nr_scales; ++j)
+        {
+            struct image scaled;
 
-        if (image_load(image))
+            if (convert_image_scale(convert, image, &scaled, convert->scales[j]) ||
+                convert_image_outputs(convert, &scaled, outputs, &nr_outputs))
+            {
+                image_free(&scaled);
+                goto error;
+            }
+
+            image_free(&scaled);
+        }
+
+        memory_free(image->data);
+        image->data = NULL;
+    }
+
+    if (outputs != NULL)
+    {
+        for (uint32_t i = 0; i < convert->nr_images; ++i)
+        {
+            image_free(&convert->images[i]);
+        }
+
+        memory_free(convert->images);
+        convert->images = outputs;
+        convert->nr_images = nr_outputs;
+        convert->nr_images_alloc = nr_outputs;
+    }
+
+    return 0;
+
+error:
+    for (uint32_t i = 0; i < nr_outputs; ++i)
+    {
+        image_free(&outputs[i]);
+    }
+    memory_free(outputs);
+    return -1;
+}
+
+/* resample each image into rotation frames, output as a tileset of frames */
+static int convert_rotations(struct convert *convert)
+{
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        struct image *source = &convert->images[i];
+        struct tileset *tileset;
+        struct image *image;
+
+        if (convert_load_image(convert, source))
+        {
+            return -1;
+        }
+
+        if (image_rotate_frames(source, convert->nr_rotations))
+        {
+            return -1;
+        }
+
+        convert->tilesets = memory_grow_array(convert->tilesets, &convert->nr_tilesets_alloc, convert->nr_tilesets, sizeof(struct tileset));
+        if (convert->tilesets == NULL)
+        {
+            return -1;
+        }
+
+        tileset = &convert->tilesets[convert->nr_tilesets];
+        convert->nr_tilesets++;
+
+        /* the tileset takes over the loaded image */
+        tileset->image = *source;
+        source->name = NULL;
+        source->path = NULL;
+        source->data = NULL;
+
+        tileset->tiles = NULL;
+        tileset->nr_tiles = 0;
+        tileset->tile_width = tileset->image.width;
+        tileset->tile_height = tileset->image.height / convert->nr_rotations;
+        tileset->tile_rotate = 0;
+        tileset->tile_flip_x = false;
+        tileset->tile_flip_y = false;
+        tileset->p_table = convert->p_table;
+        tileset->delta = false;
+        tileset->nr_banks = 0;
+        tileset->tile_banks = NULL;
+
+        image = &tileset->image;
+        image->rlet = convert->style == CONVERT_STYLE_RLET;
+        image->bpp = convert_tileset_bpp(convert, tileset);
+        image->auto_bpp = convert->bpp == BPP_AUTO;
+        image->gfx = (image->rlet || convert->add_width_height) && image->bpp == BPP_8 &&
+            convert->layout == IMAGE_LAYOUT_ROW_MAJOR;
+
+        if (convert->add_width_height &&
+            (tileset->tile_width > 255 || tileset->tile_height > 255))
+        {
+            LOG_ERROR("Rotation frames are %ux%u. "
+                "Maximum is 255x255 when using the option \'width-and-height\'.\n",
+                tileset->tile_width,
+                tileset->tile_height);
+            return -1;
+        }
+
+        if (convert_tileset(convert, tileset))
         {
             return -1;
         }
 
-        if (convert->add_width_height)
+        /* every tile holds its own copy, so the source pixels can go */
+        memory_free(image->data);
+        image->data = NULL;
+    }
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        image_free(&convert->images[i]);
+    }
+
+    memory_free(convert->images);
+    convert->images = NULL;
+    convert->nr_images = 0;
+    convert->nr_images_alloc = 0;
+
+    return 0;
+}
+
+/* store the first frame fully and each later frame as the spans changed from its predecessor */
+static int convert_animation(struct convert *convert)
+{
+    struct tileset *tileset;
+    struct tileset_tile *frames = NULL;
+    uint8_t *prev = NULL;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    frames = memory_realloc_array(NULL, convert->nr_images, sizeof(struct tileset_tile));
+    if (frames == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        frames[i].data = NULL;
+        frames[i].data_size = 0;
+    }
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        struct image *image = &convert->images[i];
+        uint8_t *indices;
+
+        if (convert_load_image(convert, image) ||
+            convert_check_dimensions(convert, image) ||
+            convert_quantize_image(convert, image))
+        {
+            goto error;
+        }
+
+        if (i == 0)
+        {
+            width = image->width;
+            height = image->height;
+        }
+        else if (image->width != width || image->height != height)
+        {
+            LOG_ERROR("Animation frame \'%s\' is %ux%u, but the first frame is %ux%u.\n",
+                image->name, image->width, image->height, width, height);
+            goto error;
+        }
+
+        indices = memory_alloc(image->data_size);
+        if (indices == NULL)
+        {
+            goto error;
+        }
+
+        memcpy(indices, image->data, image->data_size);
+
+        if (i == 0)
         {
-            if (image->width > 255)
+            if (convert_image(convert, image))
             {
-                LOG_ERROR("Image width is %u. "
-                    "Maximum width is 255 when using the option \'width-and-height\'.\n",
-                    image->width);
-                return -1;
+                memory_free(indices);
+                goto error;
             }
+        }
+        else
+        {
+            uint64_t start = profile_now();
+            size_t bytes_in = image->data_size;
 
-            if (image->height > 255)
+            if (image_delta(image, prev))
             {
-                LOG_ERROR("Image height is %u. "
-                    "Maximum height is 255 when using the option \'width-and-height\'.\n",
-                    image->height);
-                return -1;
+                memory_free(indices);
+                goto error;
+            }
+            convert_stage("delta", image, bytes_in, start);
+
+            if (image_compress(image, convert->compress))
+            {
+                memory_free(indices);
+                goto error;
             }
         }
 
-        if (convert_image(convert, image))
+        memory_free(prev);
+        prev = indices;
+
+        frames[i].data = image->data;
+        frames[i].data_size = image->data_size;
+        image->data = NULL;
+    }
+
+    memory_free(prev);
+    prev = NULL;
+
+    convert->tilesets = memory_grow_array(convert->tilesets, &convert->nr_tilesets_alloc, convert->nr_tilesets, sizeof(struct tileset));
+    if (convert->tilesets == NULL)
+    {
+        goto error;
+    }
+
+    tileset = &convert->tilesets[convert->nr_tilesets];
+    convert->nr_tilesets++;
+
+    tileset->tiles = NULL;
+    tileset->nr_tiles = 0;
+
+    /* the tileset takes over the first frame, named after the convert */
+    tileset->image = convert->images[0];
+    tileset->image.indices = NULL;
+    tileset->image.mask = NULL;
+    convert->images[0].name = NULL;
+    convert->images[0].path = NULL;
+
+    memory_free(tileset->image.name);
+    tileset->image.name = strings_dup(convert->name);
+    if (tileset->image.name == NULL)
+    {
+        goto error;
+    }
+
+    tileset->image.gfx = false;
+    tileset->tiles = frames;
+    tileset->nr_tiles = convert->nr_images;
+    tileset->tile_width = width;
+    tileset->tile_height = height;
+    tileset->tile_rotate = 0;
+    tileset->tile_flip_x = false;
+    tileset->tile_flip_y = false;
+    tileset->p_table = true;
+    tileset->rlet = false;
+    tileset->compressed = convert->compress != COMPRESS_NONE;
+    tileset->delta = true;
+    tileset->nr_banks = 0;
+    tileset->tile_banks = NULL;
+
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        image_free(&convert->images[i]);
+    }
+
+    memory_free(convert->images);
+    convert->images = NULL;
+    convert->nr_images = 0;
+    convert->nr_images_alloc = 0;
+
+    return 0;
+
+error:
+    for (uint32_t i = 0; i < convert->nr_images; ++i)
+    {
+        memory_free(frames[i].data);
+    }
+    memory_free(frames);
+    memory_free(prev);
+    return -1;
+}
+
+int convert_generate(struct convert *convert,
+    struct palette **palettes,
+    const struct registry *palette_registry)
+{
+    if (convert->nr_images == 0 && convert->nr_tilesets == 0)
+    {
+        LOG_WARNING("No images or tilesets in convert \'%s\'\n",
+            convert->name);
+        return 0;
+    }
+
+    LOG_INFO("Generating convert \'%s\'\n", convert->name);
+
+    if (convert_is_palette_style(convert))
+    {
+        if (convert_find_palette(convert, palettes, palette_registry))
+        {
+            return -1;
+        }
+    }
+
+    if (convert->nr_rotations == 0 && convert->animation == CONVERT_ANIMATION_NONE)
+    {
+        if (convert_images(convert))
         {
             return -1;
         }
@@ -584,9 +1513,12 @@ int convert_generate(struct convert *convert, struct palette **palettes, uint32_
         image->flip_y = convert->flip_y;
         image->transparent_index = convert->transparent_index;
         image->rlet = convert->style == CONVERT_STYLE_RLET;
+        image->bpp = convert_tileset_bpp(convert, tileset);
+        image->auto_bpp = convert->bpp == BPP_AUTO;
 
         image->gfx = false;
-        if ((image->rlet || convert->add_width_height) && convert->bpp == BPP_8)
+        if ((image->rlet || convert->add_width_height) && image->bpp == BPP_8 &&
+            convert->layout == IMAGE_LAYOUT_ROW_MAJOR)
         {
             image->gfx = true;
         }
@@ -604,5 +1536,21 @@ int convert_generate(struct convert *convert, struct palette **palettes, uint32_
         }
     }
 
+    if (convert->nr_rotations != 0)
+    {
+        if (convert_rotations(convert))
+        {
+            return -1;
+        }
+    }
+
+    if (convert->animation == CONVERT_ANIMATION_DELTA)
+    {
+        if (convert_animation(convert))
+        {
+            return -1;
+        }
+    }
+
     return 0;
 }
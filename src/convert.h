@@ -35,20 +35,45 @@
 #include "palette.h"
 #include "tileset.h"
 #include "compress.h"
+#include "registry.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define CONVERT_DEFAULT_QUANTIZE_SPEED 3
+#define CONVERT_MAX_ROTATIONS 256
+#define CONVERT_MAX_SCALES 8
+#define CONVERT_MAX_SCALE 16
 
 typedef enum
 {
     CONVERT_STYLE_PALETTE,
     CONVERT_STYLE_RLET,
     CONVERT_STYLE_DIRECT,
+    CONVERT_STYLE_AUTO,
+    CONVERT_STYLE_COMPILED,
 } convert_style_t;
 
+typedef enum
+{
+    CONVERT_OBJECTIVE_SIZE,
+    CONVERT_OBJECTIVE_SPEED,
+} convert_objective_t;
+
+typedef enum
+{
+    CONVERT_ANIMATION_NONE,
+    CONVERT_ANIMATION_DELTA,
+} convert_animation_t;
+
+struct convert_encoding
+{
+    bool rlet;
+    bpp_t bpp;
+    compress_mode_t compress;
+};
+
 struct convert
 {
     char *name;
@@ -60,13 +85,16 @@ struct convert
     uint8_t transparent_index;
     struct image *images;
     uint32_t nr_images;
+    uint32_t nr_images_alloc;
     struct tileset *tilesets;
     uint32_t nr_tilesets;
+    uint32_t nr_tilesets_alloc;
     uint32_t tile_height;
     uint32_t tile_width;
     bool p_table;
     compress_mode_t compress;
     convert_style_t style;
+    convert_objective_t style_objective;
     color_format_t color_fmt;
     uint32_t quantize_speed;
     float dither;
@@ -74,10 +102,25 @@ struct convert
     bool add_width_height;
     bool flip_x;
     bool flip_y;
+    bool trim;
+    bool preshift;
+    image_transform_t variants[IMAGE_MAX_TRANSFORMS];
+    uint32_t nr_variants;
+    uint32_t nr_rotations;
+    float scales[CONVERT_MAX_SCALES];
+    uint32_t nr_scales;
+    image_scale_filter_t scale_filter;
+    bool masks;
+    image_layout_t layout;
+    uint32_t layout_stride;
+    convert_animation_t animation;
+    uint32_t palette_banks;
     uint32_t tile_rotate;
     bool tile_flip_x;
     bool tile_flip_y;
     bpp_t bpp;
+    float decode_weight;
+    bool keep_indices;
 };
 
 struct convert *convert_alloc(void);
@@ -86,7 +129,13 @@ int convert_add_image_path(struct convert *convert, const char *path);
 
 int convert_add_tileset_path(struct convert *convert, const char *path);
 
-int convert_generate(struct convert *convert, struct palette **palettes, uint32_t nr_palettes);
+int convert_generate(struct convert *convert,
+    struct palette **palettes,
+    const struct registry *palette_registry);
+
+int convert_encode_image(const struct convert *convert, struct image *image, const struct convert_encoding *encoding);
+
+void convert_release(struct convert *convert);
 
 void convert_free(struct convert *convert);
 
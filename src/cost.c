@@ -0,0 +1,81 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cost.h"
+
+/*
+ * Rough ez80 cycle estimates for drawing converted data with graphx.
+ * These only need to rank encodings against each other, not predict
+ * exact timings; wait states and clipping are not modeled.
+ */
+#define CYCLES_SPRITE_ROW 40
+#define CYCLES_SPRITE_PIXEL 14
+#define CYCLES_UNPACK_PIXEL 18
+#define CYCLES_RLET_ROW 24
+#define CYCLES_RLET_RUN 30
+#define CYCLES_RLET_PIXEL 5
+#define CYCLES_ZX7_BYTE 28
+#define CYCLES_ZX0_BYTE 40
+
+uint32_t cost_sprite_draw(uint32_t width, uint32_t height, bpp_t bpp)
+{
+    uint32_t cycles;
+
+    cycles = (height * CYCLES_SPRITE_ROW) + (width * height * CYCLES_SPRITE_PIXEL);
+
+    /* packed pixels are shifted out by a custom routine */
+    if (bpp != BPP_8)
+    {
+        cycles += width * height * CYCLES_UNPACK_PIXEL;
+    }
+
+    return cycles;
+}
+
+uint32_t cost_rlet_draw(uint32_t height, const struct image_rlet_stats *stats)
+{
+    return (height * CYCLES_RLET_ROW) +
+           (stats->nr_runs * CYCLES_RLET_RUN) +
+           (stats->nr_opaque * CYCLES_RLET_PIXEL);
+}
+
+uint32_t cost_decompress(compress_mode_t mode, uint32_t uncompressed_size)
+{
+    /* decompression is charged per output byte */
+    switch (mode)
+    {
+        case COMPRESS_ZX7:
+            return uncompressed_size * CYCLES_ZX7_BYTE;
+        case COMPRESS_ZX0:
+            return uncompressed_size * CYCLES_ZX0_BYTE;
+        default:
+            return 0;
+    }
+}
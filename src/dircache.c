@@ -0,0 +1,338 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* the glob hook members use their native types when this is defined */
+#define _GNU_SOURCE
+
+#include "dircache.h"
+#include "registry.h"
+#include "strings.h"
+#include "memory.h"
+#include "log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * Every directory glob visits is read once and kept for the whole run, so
+ * patterns sharing a directory reuse one listing and existence checks are
+ * answered from it rather than from the filesystem.
+ */
+struct dircache_dir
+{
+    char *path;
+    int error;
+    struct dirent *entries;
+    uint32_t nr_entries;
+    uint32_t nr_entries_alloc;
+    struct registry names;
+};
+
+/* streams refer to their directory by index, as the array may grow */
+struct dircache_stream
+{
+    uint32_t dir;
+    uint32_t pos;
+};
+
+static struct
+{
+    struct dircache_dir *dirs;
+    uint32_t nr_dirs;
+    uint32_t nr_dirs_alloc;
+    struct registry registry;
+} dircache;
+
+static int dircache_read(struct dircache_dir *dir)
+{
+    struct dirent *entry;
+    DIR *stream;
+
+    stream = opendir(dir->path);
+    if (stream == NULL)
+    {
+        dir->error = errno;
+        return 0;
+    }
+
+    while ((entry = readdir(stream)) != NULL)
+    {
+        size_t len = strlen(entry->d_name);
+        struct dirent *copy;
+
+        if (len >= sizeof(copy->d_name))
+        {
+            len = sizeof(copy->d_name) - 1;
+        }
+
+        dir->entries = memory_grow_array(dir->entries, &dir->nr_entries_alloc,
+            dir->nr_entries, sizeof(struct dirent));
+        if (dir->entries == NULL)
+        {
+            dir->nr_entries = 0;
+            closedir(stream);
+            return -1;
+        }
+
+        copy = &dir->entries[dir->nr_entries];
+        memset(copy, 0, sizeof(struct dirent));
+        copy->d_ino = entry->d_ino;
+#ifdef DT_UNKNOWN
+        copy->d_type = entry->d_type;
+#endif
+        memcpy(copy->d_name, entry->d_name, len);
+
+        dir->nr_entries++;
+    }
+
+    closedir(stream);
+
+    /* entries no longer move, so their names can be indexed */
+    for (uint32_t i = 0; i < dir->nr_entries; ++i)
+    {
+        if (registry_add(&dir->names, dir->entries[i].d_name, i) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int dircache_list(const char *path, uint32_t *index)
+{
+    struct dircache_dir *dir;
+
+    if (!registry_find(&dircache.registry, path, index))
+    {
+        return 0;
+    }
+
+    dircache.dirs = memory_grow_array(dircache.dirs, &dircache.nr_dirs_alloc,
+        dircache.nr_dirs, sizeof(struct dircache_dir));
+    if (dircache.dirs == NULL)
+    {
+        dircache.nr_dirs = 0;
+        registry_free(&dircache.registry);
+        return -1;
+    }
+
+    dir = &dircache.dirs[dircache.nr_dirs];
+    dir->error = 0;
+    dir->entries = NULL;
+    dir->nr_entries = 0;
+    dir->nr_entries_alloc = 0;
+    registry_init(&dir->names);
+
+    dir->path = strings_dup(path);
+    if (dir->path == NULL)
+    {
+        return -1;
+    }
+
+    dircache.nr_dirs++;
+
+    if (dircache_read(dir))
+    {
+        return -1;
+    }
+
+    *index = dircache.nr_dirs - 1;
+
+    return registry_add(&dircache.registry, dir->path, *index) < 0 ? -1 : 0;
+}
+
+static void *dircache_opendir(const char *path)
+{
+    struct dircache_stream *stream;
+    uint32_t index;
+
+    if (dircache_list(path, &index))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (dircache.dirs[index].error != 0)
+    {
+        errno = dircache.dirs[index].error;
+        return NULL;
+    }
+
+    stream = memory_alloc(sizeof(struct dircache_stream));
+    if (stream == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    stream->dir = index;
+    stream->pos = 0;
+
+    return stream;
+}
+
+static struct dirent *dircache_readdir(void *ptr)
+{
+    struct dircache_stream *stream = ptr;
+    struct dircache_dir *dir = &dircache.dirs[stream->dir];
+
+    if (stream->pos >= dir->nr_entries)
+    {
+        return NULL;
+    }
+
+    return &dir->entries[stream->pos++];
+}
+
+static void dircache_closedir(void *ptr)
+{
+    memory_free(ptr);
+}
+
+static int dircache_real_stat(const char *path, struct stat *st, bool follow)
+{
+#ifdef _WIN32
+    (void)follow;
+    return stat(path, st);
+#else
+    return follow ? stat(path, st) : lstat(path, st);
+#endif
+}
+
+/* answers from the parent listing, only asking the filesystem if it must */
+static int dircache_stat_path(const char *path, struct stat *st, bool follow)
+{
+    const struct dirent *entry;
+    const char *name;
+    char *parent;
+    uint32_t index;
+    uint32_t i;
+    int ret;
+
+    name = strrchr(path, '/');
+    if (name == NULL)
+    {
+        parent = strings_dup(".");
+        name = path;
+    }
+    else
+    {
+        parent = strings_dup(path);
+        if (parent != NULL)
+        {
+            parent[name - path > 0 ? name - path : 1] = '\0';
+        }
+        name++;
+    }
+
+    if (parent == NULL || *name == '\0')
+    {
+        memory_free(parent);
+        return dircache_real_stat(path, st, follow);
+    }
+
+    ret = dircache_list(parent, &index);
+    memory_free(parent);
+
+    if (ret || dircache.dirs[index].error != 0)
+    {
+        return dircache_real_stat(path, st, follow);
+    }
+
+    /* names from wildcards always hit; a literal may differ in case only */
+    if (registry_find(&dircache.dirs[index].names, name, &i))
+    {
+        return dircache_real_stat(path, st, follow);
+    }
+
+    entry = &dircache.dirs[index].entries[i];
+
+#ifdef DT_UNKNOWN
+    if (entry->d_type == DT_REG || entry->d_type == DT_DIR ||
+        (entry->d_type == DT_LNK && !follow))
+    {
+        memset(st, 0, sizeof(struct stat));
+        st->st_ino = entry->d_ino;
+        st->st_mode =
+            entry->d_type == DT_REG ? S_IFREG :
+            entry->d_type == DT_DIR ? S_IFDIR : S_IFLNK;
+        return 0;
+    }
+#else
+    (void)entry;
+#endif
+
+    return dircache_real_stat(path, st, follow);
+}
+
+static int dircache_stat(const char *path, struct stat *st)
+{
+    return dircache_stat_path(path, st, true);
+}
+
+static int dircache_lstat(const char *path, struct stat *st)
+{
+    return dircache_stat_path(path, st, false);
+}
+
+int dircache_glob(const char *pattern, glob_t *globbuf)
+{
+    globbuf->gl_opendir = dircache_opendir;
+    globbuf->gl_readdir = dircache_readdir;
+    globbuf->gl_closedir = dircache_closedir;
+    globbuf->gl_stat = dircache_stat;
+    globbuf->gl_lstat = dircache_lstat;
+
+    return glob(pattern, GLOB_ALTDIRFUNC, NULL, globbuf);
+}
+
+void dircache_free(void)
+{
+    for (uint32_t i = 0; i < dircache.nr_dirs; ++i)
+    {
+        struct dircache_dir *dir = &dircache.dirs[i];
+
+        registry_free(&dir->names);
+        memory_free(dir->entries);
+        memory_free(dir->path);
+    }
+
+    registry_free(&dircache.registry);
+
+    memory_free(dircache.dirs);
+    dircache.dirs = NULL;
+    dircache.nr_dirs = 0;
+    dircache.nr_dirs_alloc = 0;
+}
@@ -87,7 +87,7 @@ int icon_convert(struct icon *icon)
             LOG_WARNING("Icon \'%s\' is not 16x16 pixels.\n", image.path);
         }
 
-        liqattr = liq_attr_create();
+        liqattr = liq_attr_create_with_allocator(memory_alloc, memory_free);
         if (liqattr == NULL)
         {
             LOG_ERROR("Failed creating icon image attributes.\n");
@@ -232,7 +232,7 @@ fail:
         }
         
         image_free(&image);
-        free(data);
+        memory_free(data);
     }
 
     return ret;
@@ -32,10 +32,21 @@
 #include "palette.h"
 #include "strings.h"
 #include "memory.h"
+#include "profile.h"
+#include "stats.h"
 #include "log.h"
 
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 #include "deps/libimagequant/libimagequant.h"
 
+#define STBI_MALLOC(size) memory_lib_realloc(NULL, size)
+#define STBI_REALLOC(ptr, size) memory_lib_realloc(ptr, size)
+#define STBI_FREE(ptr) memory_free(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include "deps/stb/stb_image.h"
 
@@ -76,11 +87,15 @@ int image_rotate_90(uint32_t *data, uint32_t width, uint32_t height)
 {
     uint32_t *new_data;
     uint32_t data_size;
+    size_t mark;
+
+    mark = memory_scratch_mark();
 
     data_size = width * height * 4;
-    new_data = memory_alloc(data_size);
+    new_data = memory_scratch_alloc(data_size);
     if (new_data == NULL)
     {
+        memory_scratch_release(mark);
         return -1;
     }
 
@@ -95,11 +110,525 @@ int image_rotate_90(uint32_t *data, uint32_t width, uint32_t height)
     }
 
     memcpy(data, new_data, data_size);
-    free(new_data);
+    memory_scratch_release(mark);
 
     return 0;
 }
 
+/* dihedral transforms, matching the flip and rotate options */
+int image_transform(struct image *image, image_transform_t transform, uint32_t pixel_size)
+{
+    int64_t width = image->width;
+    int64_t height = image->height;
+    int64_t origin;
+    int64_t step_x;
+    int64_t step_y;
+    uint32_t new_width = image->width;
+    uint32_t new_height = image->height;
+    uint8_t *new_data;
+    uint8_t *dst;
+
+    /* source pixel = origin + (x * step_x) + (y * step_y) */
+    switch (transform)
+    {
+        default:
+        case IMAGE_TRANSFORM_NONE:
+            return 0;
+        case IMAGE_TRANSFORM_FLIP_X:
+            origin = (height - 1) * width;
+            step_x = 1;
+            step_y = -width;
+            break;
+        case IMAGE_TRANSFORM_FLIP_Y:
+            origin = width - 1;
+            step_x = -1;
+            step_y = width;
+            break;
+        case IMAGE_TRANSFORM_ROT_90:
+            origin = (height - 1) * width;
+            step_x = -width;
+            step_y = 1;
+            break;
+        case IMAGE_TRANSFORM_ROT_180:
+            origin = (height * width) - 1;
+            step_x = -1;
+            step_y = -width;
+            break;
+        case IMAGE_TRANSFORM_ROT_270:
+            origin = width - 1;
+            step_x = width;
+            step_y = -1;
+            break;
+        case IMAGE_TRANSFORM_TRANSPOSE:
+            origin = 0;
+            step_x = width;
+            step_y = 1;
+            break;
+        case IMAGE_TRANSFORM_TRANSVERSE:
+            origin = (height * width) - 1;
+            step_x = -width;
+            step_y = -1;
+            break;
+    }
+
+    if (step_y == 1 || step_y == -1)
+    {
+        new_width = image->height;
+        new_height = image->width;
+    }
+
+    new_data = memory_realloc_array(NULL, image->width * image->height, pixel_size);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
+
+    dst = new_data;
+
+    for (uint32_t y = 0; y < new_height; ++y)
+    {
+        int64_t src = origin + (y * step_y);
+
+        for (uint32_t x = 0; x < new_width; ++x)
+        {
+            memcpy(dst, &image->data[src * pixel_size], pixel_size);
+            dst += pixel_size;
+            src += step_x;
+        }
+    }
+
+    /* carry the trimmed rectangle into the transformed frame */
+    if (image->trimmed)
+    {
+        uint32_t x = image->trim_x;
+        uint32_t y = image->trim_y;
+        uint32_t mirror_x = 0;
+        uint32_t mirror_y = 0;
+
+        /* scaled offsets are rounded, so the far edge may overshoot */
+        if (image->orig_width > image->trim_x + image->width)
+        {
+            mirror_x = image->orig_width - image->trim_x - image->width;
+        }
+        if (image->orig_height > image->trim_y + image->height)
+        {
+            mirror_y = image->orig_height - image->trim_y - image->height;
+        }
+
+        switch (transform)
+        {
+            default:
+                break;
+            case IMAGE_TRANSFORM_FLIP_X:
+                image->trim_y = mirror_y;
+                break;
+            case IMAGE_TRANSFORM_FLIP_Y:
+                image->trim_x = mirror_x;
+                break;
+            case IMAGE_TRANSFORM_ROT_90:
+                image->trim_x = mirror_y;
+                image->trim_y = x;
+                break;
+            case IMAGE_TRANSFORM_ROT_180:
+                image->trim_x = mirror_x;
+                image->trim_y = mirror_y;
+                break;
+            case IMAGE_TRANSFORM_ROT_270:
+                image->trim_x = y;
+                image->trim_y = mirror_x;
+                break;
+            case IMAGE_TRANSFORM_TRANSPOSE:
+                image->trim_x = y;
+                image->trim_y = x;
+                break;
+            case IMAGE_TRANSFORM_TRANSVERSE:
+                image->trim_x = mirror_y;
+                image->trim_y = mirror_x;
+                break;
+        }
+
+        if (step_y == 1 || step_y == -1)
+        {
+            uint32_t orig_width = image->orig_width;
+
+            image->orig_width = image->orig_height;
+            image->orig_height = orig_width;
+        }
+    }
+
+    memory_free(image->data);
+    image->data = new_data;
+    image->width = new_width;
+    image->height = new_height;
+
+    return 0;
+}
+
+/* catmull-rom weight for a tap at distance t */
+static float image_cubic_weight(float t)
+{
+    t = fabsf(t);
+
+    if (t < 1.0f)
+    {
+        return ((1.5f * t - 2.5f) * t * t) + 1.0f;
+    }
+
+    if (t < 2.0f)
+    {
+        return (((-0.5f * t + 2.5f) * t) - 4.0f) * t + 2.0f;
+    }
+
+    return 0.0f;
+}
+
+/* bicubic sample on premultiplied alpha; outside the image is transparent */
+static void image_sample_bicubic(const uint8_t *data, uint32_t width, uint32_t height,
+    float x, float y, uint8_t *out)
+{
+    int32_t ix = (int32_t)floorf(x);
+    int32_t iy = (int32_t)floorf(y);
+    float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    for (int32_t j = iy - 1; j <= iy + 2; ++j)
+    {
+        float wy = image_cubic_weight(y - j);
+
+        if (j < 0 || j >= (int32_t)height)
+        {
+            continue;
+        }
+
+        for (int32_t i = ix - 1; i <= ix + 2; ++i)
+        {
+            const uint8_t *pixel;
+            float weight;
+            float alpha;
+
+            if (i < 0 || i >= (int32_t)width)
+            {
+                continue;
+            }
+
+            pixel = &data[((j * width) + i) * 4];
+            weight = wy * image_cubic_weight(x - i);
+            alpha = pixel[3] * weight;
+
+            sum[0] += pixel[0] * alpha;
+            sum[1] += pixel[1] * alpha;
+            sum[2] += pixel[2] * alpha;
+            sum[3] += alpha;
+        }
+    }
+
+    /* snap alpha so quantization does not have to round it */
+    if (sum[3] < 127.5f)
+    {
+        out[0] = out[1] = out[2] = out[3] = 0;
+        return;
+    }
+
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        float value = sum[c] / sum[3];
+
+        out[c] = value < 0.0f ? 0 : value > 255.0f ? 255 : (uint8_t)(value + 0.5f);
+    }
+
+    out[3] = 255;
+}
+
+/* canvas edge that fits any rotation and keeps the unrotated frame on whole pixels */
+static uint32_t image_frame_size(uint32_t diagonal, uint32_t size)
+{
+    return diagonal + ((diagonal - size) & 1);
+}
+
+int image_rotate_frames(struct image *image, uint32_t nr_frames)
+{
+    uint32_t diagonal;
+    uint32_t frame_width;
+    uint32_t frame_height;
+    uint8_t *new_data;
+    uint8_t *dst;
+
+    diagonal = (uint32_t)ceil(sqrt(((double)image->width * image->width) +
+                                   ((double)image->height * image->height)));
+
+    frame_width = image_frame_size(diagonal, image->width);
+    frame_height = image_frame_size(diagonal, image->height);
+
+    new_data = memory_realloc_array(NULL, (size_t)frame_width * frame_height * nr_frames, 4);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
+
+    dst = new_data;
+
+    /* frames are stacked vertically, rotating clockwise like 'rotate' */
+    for (uint32_t k = 0; k < nr_frames; ++k)
+    {
+        double angle = (2.0 * M_PI * k) / nr_frames;
+        float c = (float)cos(angle);
+        float s = (float)sin(angle);
+
+        for (uint32_t y = 0; y < frame_height; ++y)
+        {
+            float dy = (y + 0.5f) - (frame_height / 2.0f);
+
+            for (uint32_t x = 0; x < frame_width; ++x)
+            {
+                float dx = (x + 0.5f) - (frame_width / 2.0f);
+                float sx = (dx * c) + (dy * s) + (image->width / 2.0f) - 0.5f;
+                float sy = (dy * c) - (dx * s) + (image->height / 2.0f) - 0.5f;
+
+                image_sample_bicubic(image->data, image->width, image->height, sx, sy, dst);
+                dst += 4;
+            }
+        }
+    }
+
+    memory_free(image->data);
+    image->data = new_data;
+    image->width = frame_width;
+    image->height = frame_height * nr_frames;
+
+    return 0;
+}
+
+/* lanczos-3 weight for a tap at distance t */
+static float image_lanczos_weight(float t)
+{
+    float pt;
+
+    t = fabsf(t);
+
+    if (t < 1e-6f)
+    {
+        return 1.0f;
+    }
+
+    if (t >= 3.0f)
+    {
+        return 0.0f;
+    }
+
+    pt = (float)M_PI * t;
+
+    return (3.0f * sinf(pt) * sinf(pt / 3.0f)) / (pt * pt);
+}
+
+/*
+ * Builds the filter taps for resampling one axis from src to dst pixels.
+ * Every destination pixel gets the same number of taps starting at first[i],
+ * which keeps the inner loops free of bounds checks.
+ */
+static float *image_scale_weights(uint32_t src, uint32_t dst, image_scale_filter_t filter,
+    uint32_t **first, uint32_t *nr_taps)
+{
+    float scale = (float)dst / src;
+    float support;
+    uint32_t taps;
+    float *weights;
+
+    if (filter == IMAGE_SCALE_LANCZOS)
+    {
+        support = scale < 1.0f ? 3.0f / scale : 3.0f;
+    }
+    else
+    {
+        support = 0.5f / scale;
+    }
+
+    taps = (uint32_t)ceilf(support * 2.0f) + 1;
+    if (taps > src)
+    {
+        taps = src;
+    }
+
+    weights = memory_realloc_array(NULL, (size_t)dst * taps, sizeof(float));
+    *first = memory_realloc_array(NULL, dst, sizeof(uint32_t));
+    if (weights == NULL || *first == NULL)
+    {
+        memory_free(weights);
+        memory_free(*first);
+        *first = NULL;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < dst; ++i)
+    {
+        float center = (i + 0.5f) / scale;
+        float *w = &weights[(size_t)i * taps];
+        float total = 0.0f;
+        int32_t start;
+
+        start = (int32_t)floorf(center - (taps / 2.0f));
+        if (start < 0)
+        {
+            start = 0;
+        }
+        if (start + taps > src)
+        {
+            start = src - taps;
+        }
+
+        for (uint32_t j = 0; j < taps; ++j)
+        {
+            float x = start + j + 0.5f;
+
+            if (filter == IMAGE_SCALE_LANCZOS)
+            {
+                w[j] = image_lanczos_weight((x - center) * (scale < 1.0f ? scale : 1.0f));
+            }
+            else
+            {
+                /* coverage of the source pixel by the destination footprint */
+                float lo = fmaxf(x - 0.5f, center - support);
+                float hi = fminf(x + 0.5f, center + support);
+
+                w[j] = hi > lo ? hi - lo : 0.0f;
+            }
+
+            total += w[j];
+        }
+
+        for (uint32_t j = 0; j < taps; ++j)
+        {
+            w[j] = total != 0.0f ? w[j] / total : 0.0f;
+        }
+
+        (*first)[i] = start;
+    }
+
+    *nr_taps = taps;
+
+    return weights;
+}
+
+int image_scale(struct image *image, uint32_t width, uint32_t height, image_scale_filter_t filter)
+{
+    uint32_t *first_x = NULL;
+    uint32_t *first_y = NULL;
+    float *weights_x = NULL;
+    float *weights_y = NULL;
+    float *rows = NULL;
+    float *row = NULL;
+    uint8_t *new_data = NULL;
+    uint32_t taps_x;
+    uint32_t taps_y;
+
+    weights_x = image_scale_weights(image->width, width, filter, &first_x, &taps_x);
+    weights_y = image_scale_weights(image->height, height, filter, &first_y, &taps_y);
+    rows = memory_realloc_array(NULL, (size_t)width * image->height * 4, sizeof(float));
+    row = memory_realloc_array(NULL, (size_t)width * 4, sizeof(float));
+    new_data = memory_realloc_array(NULL, (size_t)width * height, 4);
+    if (weights_x == NULL || weights_y == NULL ||
+        rows == NULL || row == NULL || new_data == NULL)
+    {
+        goto error;
+    }
+
+    /* horizontal pass into premultiplied float rows */
+    for (uint32_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t *src = &image->data[(size_t)y * image->width * 4];
+        float *dst = &rows[(size_t)y * width * 4];
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const uint8_t *pixel = &src[first_x[x] * 4];
+            const float *w = &weights_x[(size_t)x * taps_x];
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+            for (uint32_t j = 0; j < taps_x; ++j)
+            {
+                float alpha = pixel[3] * w[j];
+
+                sum[0] += pixel[0] * alpha;
+                sum[1] += pixel[1] * alpha;
+                sum[2] += pixel[2] * alpha;
+                sum[3] += alpha;
+                pixel += 4;
+            }
+
+            dst[0] = sum[0];
+            dst[1] = sum[1];
+            dst[2] = sum[2];
+            dst[3] = sum[3];
+            dst += 4;
+        }
+    }
+
+    /* vertical pass works on whole rows so the compiler can vectorize it */
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const float *w = &weights_y[(size_t)y * taps_y];
+        uint8_t *dst = &new_data[(size_t)y * width * 4];
+
+        memset(row, 0, (size_t)width * 4 * sizeof(float));
+
+        for (uint32_t j = 0; j < taps_y; ++j)
+        {
+            const float *src = &rows[(size_t)(first_y[y] + j) * width * 4];
+            float weight = w[j];
+
+            for (uint32_t i = 0; i < width * 4; ++i)
+            {
+                row[i] += src[i] * weight;
+            }
+        }
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const float *sum = &row[x * 4];
+
+            /* snap alpha like rotation frames so quantization does not round it */
+            if (sum[3] < 127.5f)
+            {
+                dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            }
+            else
+            {
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    float value = sum[c] / sum[3];
+
+                    dst[c] = value < 0.0f ? 0 : value > 255.0f ? 255 : (uint8_t)(value + 0.5f);
+                }
+                dst[3] = 255;
+            }
+
+            dst += 4;
+        }
+    }
+
+    memory_free(image->data);
+    image->data = new_data;
+    image->width = width;
+    image->height = height;
+
+    memory_free(first_x);
+    memory_free(first_y);
+    memory_free(weights_x);
+    memory_free(weights_y);
+    memory_free(rows);
+    memory_free(row);
+
+    return 0;
+
+error:
+    memory_free(first_x);
+    memory_free(first_y);
+    memory_free(weights_x);
+    memory_free(weights_y);
+    memory_free(rows);
+    memory_free(row);
+    memory_free(new_data);
+    return -1;
+}
+
 void image_init(struct image *image, const char *path)
 {
     /* normal intiialization */
@@ -110,20 +639,56 @@ void image_init(struct image *image, const char *path)
     image->width = 0;
     image->height = 0;
 
+    /* set when trimmed */
+    image->trimmed = false;
+    image->trim_x = 0;
+    image->trim_y = 0;
+    image->orig_width = 0;
+    image->orig_height = 0;
+
     /* set by convert */
     image->quantize_speed = 1;
     image->dither =  0.0;
     image->rlet = false;
+    image->auto_rlet = false;
+    image->compiled = false;
+    image->preshift = false;
+
+    /* set when preshifted */
+    image->nr_shifts = 0;
+    image->shift_width = 0;
+    image->shift_size = 0;
     image->rotate = 0;
     image->flip_x = false;
     image->flip_y = false;
     image->compressed = false;
     image->uncompressed_size = 0;
     image->transparent_index = 0;
+    image->bpp = BPP_8;
+    image->auto_bpp = false;
+    image->nr_sub_palette_entries = 0;
+
+    /* set when the data is not tightly packed row-major */
+    image->layout = IMAGE_LAYOUT_ROW_MAJOR;
+    image->stride = 0;
+
+    /* set when a collision mask is requested */
+    image->masked = false;
+    image->mask = NULL;
+    image->mask_size = 0;
+    image->mask_stride = 0;
+    image->mask_compressed = false;
+
+    /* set when the encoding is chosen by an appvar budget */
+    image->keep_indices = false;
+    image->indices = NULL;
+    image->auto_encoded = false;
+    image->compress = COMPRESS_NONE;
 }
 
 int image_load(struct image *image)
 {
+    memory_tag_t tag;
     uint32_t *data;
     uint32_t width;
     uint32_t height;
@@ -131,9 +696,13 @@ int image_load(struct image *image)
     int h;
     int c;
 
+    profile_begin("decode", image->path);
+    tag = memory_set_tag(MEMORY_TAG_DECODE);
     data = (uint32_t *)stbi_load(image->path,
                                  &w, &h, &c,
                                  STBI_rgb_alpha);
+    memory_set_tag(tag);
+    profile_end("decode", image->path);
     if (data == NULL)
     {
         LOG_ERROR("Could not load image \'%s\'.\n", image->path);
@@ -150,6 +719,8 @@ int image_load(struct image *image)
     width = w;
     height = h;
 
+    stats_decode(width, height);
+
     /* converted nothing, so no data size yet */
     image->data_size = 0;
 
@@ -194,113 +765,605 @@ int image_load(struct image *image)
             image->data = (uint8_t *)data;
             break;
 
-        case 270:
-            image->width = height;
-            image->height = width;
-            if (image_rotate_90(data, width, height))
+        case 270:
+            image->width = height;
+            image->height = width;
+            if (image_rotate_90(data, width, height))
+            {
+                goto error;
+            }
+            image_flip_y(data, width, height);
+            image_flip_x(data, width, height);
+            image->data = (uint8_t *)data;
+            break;
+    }
+
+    return 0;
+
+error:
+    memory_free(data);
+    return -1;
+}
+
+void image_free(struct image *image)
+{
+    if (image == NULL)
+    {
+        return;
+    }
+
+    memory_free(image->name);
+    memory_free(image->path);
+    memory_free(image->data);
+    memory_free(image->indices);
+    memory_free(image->mask);
+}
+
+/* each shifted copy gets its own header, so any copy can be drawn alone */
+static int image_add_shift_width_and_height(struct image *image)
+{
+    uint32_t new_shift_size = image->shift_size + WIDTH_HEIGHT_SIZE;
+    uint8_t *new_data;
+
+    if (image->shift_width > 255)
+    {
+        LOG_ERROR("Preshifted image width is %u. "
+            "Maximum width is 255 when using the option \'width-and-height\'.\n",
+            image->shift_width);
+        return -1;
+    }
+
+    new_data = memory_realloc_array(NULL, image->nr_shifts, new_shift_size);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < image->nr_shifts; ++i)
+    {
+        uint8_t *dst = &new_data[i * new_shift_size];
+
+        dst[0] = image->shift_width;
+        dst[1] = image->height;
+
+        memcpy(dst + WIDTH_HEIGHT_SIZE,
+               &image->data[i * image->shift_size],
+               image->shift_size);
+    }
+
+    memory_free(image->data);
+    image->data = new_data;
+    image->data_size = image->nr_shifts * new_shift_size;
+    image->shift_size = new_shift_size;
+
+    return 0;
+}
+
+int image_add_width_and_height(struct image *image)
+{
+    if (image->nr_shifts)
+    {
+        return image_add_shift_width_and_height(image);
+    }
+
+    image->data = memory_realloc(image->data, image->data_size + WIDTH_HEIGHT_SIZE);
+    if (image->data == NULL)
+    {
+        return -1;
+    }
+
+    memmove(image->data + WIDTH_HEIGHT_SIZE, image->data, image->data_size);
+
+    image->data[0] = image->width;
+    image->data[1] = image->height;
+
+    image->data_size += WIDTH_HEIGHT_SIZE;
+
+    return 0;
+}
+
+int image_trim(struct image *image, uint32_t align)
+{
+    uint32_t min_x = image->width;
+    uint32_t min_y = image->height;
+    uint32_t max_x = 0;
+    uint32_t max_y = 0;
+    uint32_t new_width;
+    uint32_t new_height;
+
+    /* pixels below half alpha are rounded to transparent when quantizing */
+    for (uint32_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t *row = &image->data[y * image->width * 4];
+
+        for (uint32_t x = 0; x < image->width; ++x)
+        {
+            if (row[(x * 4) + 3] < 128)
+            {
+                continue;
+            }
+
+            if (x < min_x)
+            {
+                min_x = x;
+            }
+            if (x > max_x)
+            {
+                max_x = x;
+            }
+            if (y < min_y)
+            {
+                min_y = y;
+            }
+            if (y > max_y)
+            {
+                max_y = y;
+            }
+        }
+    }
+
+    image->orig_width = image->width;
+    image->orig_height = image->height;
+
+    if (min_x > max_x || min_y > max_y)
+    {
+        LOG_WARNING("Image \'%s\' is fully transparent, not trimming.\n", image->path);
+        return 0;
+    }
+
+    new_width = max_x - min_x + 1;
+    new_height = max_y - min_y + 1;
+
+    /* grow the width so packed bpp modes still fill whole bytes */
+    if (align > 1 && new_width % align)
+    {
+        new_width += align - (new_width % align);
+        if (new_width > image->width)
+        {
+            new_width = image->width;
+        }
+        if (min_x + new_width > image->width)
+        {
+            min_x = image->width - new_width;
+        }
+    }
+
+    for (uint32_t y = 0; y < new_height; ++y)
+    {
+        memmove(&image->data[y * new_width * 4],
+                &image->data[(((min_y + y) * image->width) + min_x) * 4],
+                new_width * 4);
+    }
+
+    image->trimmed = true;
+    image->trim_x = min_x;
+    image->trim_y = min_y;
+    image->width = new_width;
+    image->height = new_height;
+
+    return 0;
+}
+
+int image_rlet(struct image *image, uint8_t transparent_index)
+{
+    uint8_t *new_data;
+    uint32_t new_size;
+
+    /* multiply by 3 for worst-case encoding */
+    new_size = image->width * image->height * 3;
+    new_data = memory_scratch_alloc(new_size);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
+
+    new_size = 0;
+
+    for (uint32_t i = 0; i < image->height; i++)
+    {
+        uint32_t offset = i * image->width;
+        uint32_t left = image->width;
+
+        while (left)
+        {
+            uint32_t o;
+            uint32_t t;
+
+            t = o = 0;
+            while (t < left && transparent_index == image->data[t + offset])
+            {
+                t++;
+            }
+
+            new_data[new_size] = t;
+            new_size++;
+
+            if ((left -= t))
+            {
+                uint8_t *opaque_len = &new_data[new_size];
+                new_size++;
+
+                while (o < left && transparent_index != image->data[t + o + offset])
+                {
+                    new_data[new_size] = image->data[t + o + offset];
+                    new_size++;
+                    o++;
+                }
+
+                *opaque_len = o;
+                left -= o;
+            }
+
+            offset += o + t;
+        }
+    }
+
+    memory_free(image->data);
+    image->data = new_data;
+    image->data_size = new_size;
+
+    return 0;
+}
+
+/* ez80 adl mode opcodes used by compiled sprites */
+#define EZ80_POP_BC 0xc1
+#define EZ80_POP_HL 0xe1
+#define EZ80_POP_DE 0xd1
+#define EZ80_PUSH_BC 0xc5
+#define EZ80_PUSH_HL 0xe5
+#define EZ80_INC_HL 0x23
+#define EZ80_INC_DE 0x13
+#define EZ80_LD_BC_NNN 0x01
+#define EZ80_ADD_HL_BC 0x09
+#define EZ80_LD_IND_HL_N 0x36
+#define EZ80_PREFIX_ED 0xed
+#define EZ80_LD_IND_HL_BC 0x0f
+#define EZ80_LDIR 0xb0
+#define EZ80_EX_DE_HL 0xeb
+#define EZ80_RET 0xc9
+
+static void image_emit_ld_bc(uint8_t *code, uint32_t *size, uint32_t value)
+{
+    code[(*size)++] = EZ80_LD_BC_NNN;
+    code[(*size)++] = value & 255;
+    code[(*size)++] = (value >> 8) & 255;
+    code[(*size)++] = (value >> 16) & 255;
+}
+
+/* move hl forward to the target offset, picking the shorter sequence */
+static void image_emit_advance(uint8_t *code, uint32_t *size, uint32_t *pos, uint32_t target)
+{
+    uint32_t delta = target - *pos;
+
+    if (delta <= 4)
+    {
+        for (uint32_t i = 0; i < delta; ++i)
+        {
+            code[(*size)++] = EZ80_INC_HL;
+        }
+    }
+    else
+    {
+        image_emit_ld_bc(code, size, delta);
+        code[(*size)++] = EZ80_ADD_HL_BC;
+    }
+
+    *pos = target;
+}
+
+int image_compile(struct image *image, uint8_t transparent_index)
+{
+    uint8_t *code;
+    uint32_t size;
+    uint32_t pos;
+
+    if (image->width > IMAGE_COMPILED_STRIDE)
+    {
+        LOG_ERROR("Image width is %u. "
+            "Maximum width is %u for compiled sprites.\n",
+            image->width, IMAGE_COMPILED_STRIDE);
+        return -1;
+    }
+
+    /* worst case is an advance and a store for every pixel */
+    code = memory_alloc((image->width * image->height * 8) + 8);
+    if (code == NULL)
+    {
+        return -1;
+    }
+
+    size = 0;
+    pos = 0;
+
+    /* hl = destination, taken from the stack so c can call it directly */
+    code[size++] = EZ80_POP_BC;
+    code[size++] = EZ80_POP_HL;
+    code[size++] = EZ80_PUSH_HL;
+    code[size++] = EZ80_PUSH_BC;
+
+    for (uint32_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t *row = &image->data[y * image->width];
+        uint32_t x = 0;
+
+        while (x < image->width)
+        {
+            uint32_t run;
+            uint32_t same;
+
+            if (row[x] == transparent_index)
+            {
+                x++;
+                continue;
+            }
+
+            run = 0;
+            while (x + run < image->width && row[x + run] != transparent_index)
+            {
+                run++;
+            }
+
+            same = 1;
+            while (same < run && row[x + same] == row[x])
+            {
+                same++;
+            }
+
+            image_emit_advance(code, &size, &pos, (y * IMAGE_COMPILED_STRIDE) + x);
+
+            if (same >= IMAGE_COMPILED_MIN_FILL)
+            {
+                /* long solid spans are filled with ldir */
+                code[size++] = EZ80_LD_IND_HL_N;
+                code[size++] = row[x];
+                code[size++] = EZ80_PUSH_HL;
+                code[size++] = EZ80_POP_DE;
+                code[size++] = EZ80_INC_DE;
+                image_emit_ld_bc(code, &size, same - 1);
+                code[size++] = EZ80_PREFIX_ED;
+                code[size++] = EZ80_LDIR;
+                code[size++] = EZ80_EX_DE_HL;
+                pos += same;
+                x += same;
+            }
+            else if (run >= 3)
+            {
+                /* three pixels at once through a 24-bit store */
+                image_emit_ld_bc(code, &size, row[x] | (row[x + 1] << 8) | (row[x + 2] << 16));
+                code[size++] = EZ80_PREFIX_ED;
+                code[size++] = EZ80_LD_IND_HL_BC;
+                x += 3;
+            }
+            else
+            {
+                code[size++] = EZ80_LD_IND_HL_N;
+                code[size++] = row[x];
+                x++;
+            }
+        }
+    }
+
+    code[size++] = EZ80_RET;
+
+    memory_free(image->data);
+    image->data = code;
+    image->data_size = size;
+
+    return 0;
+}
+
+/*
+ * Replaces the indices with the spans that differ from the previous frame.
+ * Each span is a length byte, a 24-bit offset into the frame, then length
+ * indices; a zero length ends the list. Unchanged gaps shorter than a span
+ * header are absorbed into the surrounding span.
+ */
+int image_delta(struct image *image, const uint8_t *prev)
+{
+    const uint8_t *cur = image->data;
+    uint32_t size = image->data_size;
+    uint32_t spans_size = 0;
+    uint8_t *spans;
+    uint32_t i = 0;
+
+    spans = memory_alloc(size + ((size / IMAGE_DELTA_MAX_SPAN) + 1) * IMAGE_DELTA_SPAN_HEADER + 1);
+    if (spans == NULL)
+    {
+        return -1;
+    }
+
+    while (i < size)
+    {
+        uint32_t start;
+        uint32_t end;
+
+        /* skip unchanged pixels a word at a time */
+        while (i + sizeof(uint64_t) <= size &&
+               memcmp(&cur[i], &prev[i], sizeof(uint64_t)) == 0)
+        {
+            i += sizeof(uint64_t);
+        }
+
+        while (i < size && cur[i] == prev[i])
+        {
+            i++;
+        }
+
+        if (i >= size)
+        {
+            break;
+        }
+
+        start = i;
+        end = i;
+
+        while (end < size && end - start < IMAGE_DELTA_MAX_SPAN)
+        {
+            uint32_t same = 0;
+
+            if (cur[end] != prev[end])
+            {
+                end++;
+                continue;
+            }
+
+            while (end + same < size &&
+                   same < IMAGE_DELTA_SPAN_HEADER &&
+                   cur[end + same] == prev[end + same])
             {
-                goto error;
+                same++;
             }
-            image_flip_y(data, width, height);
-            image_flip_x(data, width, height);
-            image->data = (uint8_t *)data;
-            break;
-    }
 
-    return 0;
+            if (same >= IMAGE_DELTA_SPAN_HEADER || end + same >= size)
+            {
+                break;
+            }
 
-error:
-    free(data);
-    return -1;
-}
+            end += same;
+        }
 
-void image_free(struct image *image)
-{
-    if (image == NULL)
-    {
-        return;
-    }
+        if (end - start > IMAGE_DELTA_MAX_SPAN)
+        {
+            end = start + IMAGE_DELTA_MAX_SPAN;
+        }
 
-    free(image->name);
-    free(image->path);
-    free(image->data);
-}
+        spans[spans_size++] = end - start;
+        spans[spans_size++] = start & 255;
+        spans[spans_size++] = (start >> 8) & 255;
+        spans[spans_size++] = (start >> 16) & 255;
+        memcpy(&spans[spans_size], &cur[start], end - start);
+        spans_size += end - start;
 
-int image_add_width_and_height(struct image *image)
-{
-    image->data = memory_realloc(image->data, image->data_size + WIDTH_HEIGHT_SIZE);
-    if (image->data == NULL)
-    {
-        return -1;
+        i = end;
     }
 
-    memmove(image->data + WIDTH_HEIGHT_SIZE, image->data, image->data_size);
-
-    image->data[0] = image->width;
-    image->data[1] = image->height;
+    spans[spans_size++] = 0;
 
-    image->data_size += WIDTH_HEIGHT_SIZE;
+    memory_free(image->data);
+    image->data = spans;
+    image->data_size = spans_size;
 
     return 0;
 }
 
-int image_rlet(struct image *image, uint8_t transparent_index)
+/*
+ * Reorders tightly packed rows. Column-major stores each column of elements
+ * top to bottom, where an element is a pixel, or a byte of packed pixels.
+ * Padded keeps rows but spaces them stride bytes apart.
+ */
+int image_set_layout(struct image *image, image_layout_t layout, uint32_t stride)
 {
+    uint32_t row_size = image->data_size / image->height;
+    uint32_t elem_size = image->data_size / (image->width * image->height);
+    uint32_t nr_columns;
     uint8_t *new_data;
     uint32_t new_size;
 
-    /* multiply by 3 for worst-case encoding */
-    new_size = image->width * image->height * 3;
-    new_data = memory_alloc(new_size);
-    if (new_data == NULL)
+    if (elem_size == 0)
     {
-        return -1;
+        elem_size = 1;
     }
 
-    new_size = 0;
+    nr_columns = row_size / elem_size;
 
-    for (uint32_t i = 0; i < image->height; i++)
+    switch (layout)
     {
-        uint32_t offset = i * image->width;
-        uint32_t left = image->width;
-
-        while (left)
-        {
-            uint32_t o;
-            uint32_t t;
+        case IMAGE_LAYOUT_COLUMN_MAJOR:
+            new_size = image->data_size;
+            stride = image->height * elem_size;
+            break;
 
-            t = o = 0;
-            while (t < left && transparent_index == image->data[t + offset])
+        case IMAGE_LAYOUT_PADDED:
+            if (stride < row_size)
             {
-                t++;
+                LOG_ERROR("Image \'%s\' rows are %u bytes, which does not fit a padded stride of %u.\n",
+                    image->name, row_size, stride);
+                return -1;
             }
+            new_size = stride * image->height;
+            break;
 
-            new_data[new_size] = t;
-            new_size++;
+        default:
+            return 0;
+    }
 
-            if ((left -= t))
-            {
-                uint8_t *opaque_len = &new_data[new_size];
-                new_size++;
+    new_data = memory_scratch_alloc(new_size);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
 
-                while (o < left && transparent_index != image->data[t + o + offset])
-                {
-                    new_data[new_size] = image->data[t + o + offset];
-                    new_size++;
-                    o++;
-                }
+    memset(new_data, 0, new_size);
 
-                *opaque_len = o;
-                left -= o;
-            }
+    for (uint32_t y = 0; y < image->height; ++y)
+    {
+        const uint8_t *row = &image->data[y * row_size];
 
-            offset += o + t;
+        if (layout == IMAGE_LAYOUT_PADDED)
+        {
+            memcpy(&new_data[y * stride], row, row_size);
+            continue;
+        }
+
+        for (uint32_t x = 0; x < nr_columns; ++x)
+        {
+            memcpy(&new_data[(x * stride) + (y * elem_size)], &row[x * elem_size], elem_size);
         }
     }
 
-    free(image->data);
+    memory_free(image->data);
     image->data = new_data;
     image->data_size = new_size;
+    image->layout = layout;
+    image->stride = stride;
+
+    return 0;
+}
+
+/*
+ * Builds a 1 bpp mask where set bits are solid pixels, from the alpha channel
+ * of direct images or the transparent index of quantized ones. Rows are padded
+ * to whole bytes and packed like 1 bpp images, leftmost pixel in the high bit.
+ */
+int image_build_mask(struct image *image, bool direct, uint8_t transparent_index)
+{
+    struct image mask;
+
+    mask.width = (image->width + 7) & ~7u;
+    mask.height = image->height;
+    mask.data = memory_realloc_array(NULL, mask.width, mask.height);
+    if (mask.data == NULL)
+    {
+        return -1;
+    }
+
+    memset(mask.data, 0, mask.width * mask.height);
+
+    for (uint32_t y = 0; y < image->height; ++y)
+    {
+        for (uint32_t x = 0; x < image->width; ++x)
+        {
+            uint32_t i = (y * image->width) + x;
+            bool solid = direct ?
+                image->data[(i * 4) + 3] >= 128 :
+                image->data[i] != transparent_index;
+
+            mask.data[(y * mask.width) + x] = solid;
+        }
+    }
+
+    mask.data_size = mask.width * mask.height;
+
+    if (image_set_bpp(&mask, BPP_1, 2))
+    {
+        memory_free(mask.data);
+        return -1;
+    }
+
+    memory_free(image->mask);
+    image->mask = mask.data;
+    image->mask_size = mask.data_size;
+    image->mask_stride = mask.width / 8;
 
     return 0;
 }
@@ -359,7 +1422,7 @@ int image_set_bpp(struct image *image, bpp_t bpp, uint32_t nr_palette_entries)
         return -1;
     }
 
-    new_data = memory_realloc_array(NULL, image->width, image->height);
+    new_data = memory_scratch_alloc(image->width * image->height);
     if (new_data == NULL)
     {
         return -1;
@@ -387,11 +1450,273 @@ int image_set_bpp(struct image *image, bpp_t bpp, uint32_t nr_palette_entries)
         }
     }
 
-    free(image->data);
+    memory_free(image->data);
+    image->data = new_data;
+    image->data_size = new_size;
+
+    return 0;
+}
+
+int image_preshift(struct image *image, bpp_t bpp, uint32_t nr_palette_entries, uint8_t pad_index)
+{
+    uint32_t pixels_per_byte;
+    uint32_t shift_width;
+    uint8_t *new_data = NULL;
+    uint8_t *padded = NULL;
+    uint32_t new_size;
+
+    pixels_per_byte = 8 / image_bpp_bits(bpp);
+
+    /* pad pixels must fit the mode, so fall back to index 0 */
+    if (pad_index >= (1u << image_bpp_bits(bpp)))
+    {
+        pad_index = 0;
+    }
+
+    /* every shifted copy shares a stride wide enough for the largest shift */
+    shift_width = image->width + pixels_per_byte - 1;
+    shift_width += pixels_per_byte - 1;
+    shift_width -= shift_width % pixels_per_byte;
+
+    new_data = memory_realloc_array(NULL, pixels_per_byte, shift_width * image->height);
+    if (new_data == NULL)
+    {
+        goto error;
+    }
+
+    new_size = 0;
+
+    for (uint32_t shift = 0; shift < pixels_per_byte; ++shift)
+    {
+        struct image variant =
+        {
+            .width = shift_width,
+            .height = image->height,
+        };
+
+        padded = memory_alloc(shift_width * image->height);
+        if (padded == NULL)
+        {
+            goto error;
+        }
+
+        memset(padded, pad_index, shift_width * image->height);
+
+        for (uint32_t y = 0; y < image->height; ++y)
+        {
+            memcpy(&padded[(y * shift_width) + shift],
+                   &image->data[y * image->width],
+                   image->width);
+        }
+
+        variant.data = padded;
+        variant.data_size = shift_width * image->height;
+
+        if (image_set_bpp(&variant, bpp, nr_palette_entries))
+        {
+            goto error;
+        }
+
+        memcpy(&new_data[new_size], variant.data, variant.data_size);
+        new_size += variant.data_size;
+
+        image->shift_size = variant.data_size;
+
+        memory_free(variant.data);
+        padded = NULL;
+    }
+
+    memory_free(image->data);
     image->data = new_data;
     image->data_size = new_size;
+    image->nr_shifts = pixels_per_byte;
+    image->shift_width = shift_width;
 
     return 0;
+
+error:
+    memory_free(padded);
+    memory_free(new_data);
+    return -1;
+}
+
+static const struct
+{
+    bpp_t bpp;
+    uint32_t nr_entries;
+    uint32_t pixels_per_byte;
+} image_packed_modes[] =
+{
+    { BPP_1, 2, 8 },
+    { BPP_2, 4, 4 },
+    { BPP_4, 16, 2 },
+};
+
+static uint32_t image_used_indices(const struct image *image, bool *used, uint32_t *max_index)
+{
+    uint32_t nr_used = 0;
+
+    *max_index = 0;
+
+    for (uint32_t i = 0; i < PALETTE_MAX_ENTRIES; ++i)
+    {
+        used[i] = false;
+    }
+
+    for (uint32_t i = 0; i < image->data_size; ++i)
+    {
+        uint8_t index = image->data[i];
+
+        if (!used[index])
+        {
+            used[index] = true;
+            nr_used++;
+        }
+
+        if (index > *max_index)
+        {
+            *max_index = index;
+        }
+    }
+
+    return nr_used;
+}
+
+bpp_t image_min_bpp(const struct image *image)
+{
+    bool used[PALETTE_MAX_ENTRIES];
+    uint32_t max_index;
+    uint32_t nr_used;
+
+    /* omitted indices leave no regular pixel grid to pack */
+    if (image->data_size != image->width * image->height)
+    {
+        return BPP_8;
+    }
+
+    nr_used = image_used_indices(image, used, &max_index);
+
+    for (uint32_t i = 0; i < sizeof image_packed_modes / sizeof image_packed_modes[0]; ++i)
+    {
+        if (nr_used <= image_packed_modes[i].nr_entries &&
+            image->width % image_packed_modes[i].pixels_per_byte == 0)
+        {
+            return image_packed_modes[i].bpp;
+        }
+    }
+
+    return BPP_8;
+}
+
+int image_auto_bpp(struct image *image)
+{
+    bool used[PALETTE_MAX_ENTRIES];
+    uint8_t map[PALETTE_MAX_ENTRIES];
+    uint32_t nr_entries;
+    uint32_t max_index;
+    uint8_t pad_index = image->transparent_index;
+
+    image->bpp = image_min_bpp(image);
+    image->nr_sub_palette_entries = 0;
+
+    if (image->bpp == BPP_8)
+    {
+        return 0;
+    }
+
+    image_used_indices(image, used, &max_index);
+
+    nr_entries = 1u << image_bpp_bits(image->bpp);
+
+    /* remap to a compact sub-palette if the indices do not already fit */
+    if (max_index >= nr_entries)
+    {
+        uint32_t nr_used = 0;
+
+        for (uint32_t i = 0; i < PALETTE_MAX_ENTRIES; ++i)
+        {
+            if (used[i])
+            {
+                map[i] = nr_used;
+                image->sub_palette[nr_used] = i;
+                nr_used++;
+            }
+        }
+
+        for (uint32_t i = 0; i < image->data_size; ++i)
+        {
+            image->data[i] = map[image->data[i]];
+        }
+
+        image->nr_sub_palette_entries = nr_used;
+
+        pad_index = used[pad_index] ? map[pad_index] : 0;
+    }
+
+    if (image->preshift)
+    {
+        return image_preshift(image, image->bpp, nr_entries, pad_index);
+    }
+
+    return image_set_bpp(image, image->bpp, nr_entries);
+}
+
+void image_rlet_stats(const struct image *image, uint8_t transparent_index, struct image_rlet_stats *stats)
+{
+    stats->size = 0;
+    stats->nr_runs = 0;
+    stats->nr_opaque = 0;
+
+    /* mirrors the encoding in image_rlet without building it */
+    for (uint32_t i = 0; i < image->height; i++)
+    {
+        const uint8_t *row = &image->data[i * image->width];
+        uint32_t x = 0;
+
+        while (x < image->width)
+        {
+            uint32_t o = 0;
+            uint32_t t = 0;
+
+            while (x + t < image->width && row[x + t] == transparent_index)
+            {
+                t++;
+            }
+
+            stats->size++;
+            stats->nr_runs++;
+            x += t;
+
+            if (x < image->width)
+            {
+                while (x + o < image->width && row[x + o] != transparent_index)
+                {
+                    o++;
+                }
+
+                stats->size += o + 1;
+                stats->nr_opaque += o;
+                x += o;
+            }
+        }
+    }
+}
+
+uint32_t image_bpp_bits(bpp_t bpp)
+{
+    switch (bpp)
+    {
+        case BPP_1:
+            return 1;
+        case BPP_2:
+            return 2;
+        case BPP_4:
+            return 4;
+        case BPP_16:
+            return 16;
+        default:
+            return 8;
+    }
 }
 
 int image_add_offset(struct image *image, uint8_t offset)
@@ -415,7 +1740,7 @@ int image_remove_omits(struct image *image, const uint8_t *omit_indices, uint32_
     }
 
     new_size = 0;
-    new_data = memory_alloc(image->data_size);
+    new_data = memory_scratch_alloc(image->data_size);
     if (new_data == NULL)
     {
         return -1;
@@ -438,7 +1763,7 @@ nextbyte:
         continue;
     }
 
-    free(image->data);
+    memory_free(image->data);
     image->data = new_data;
     image->data_size = new_size;
 
@@ -453,7 +1778,7 @@ int image_compress(struct image *image, compress_mode_t mode)
         void *original_data = image->data;
 
         image->data = compress_array(original_data, &size, mode);
-        free(original_data);
+        memory_free(original_data);
 
         if (image->data == NULL)
         {
@@ -475,7 +1800,7 @@ int image_quantize(struct image *image, const struct palette *palette)
     uint32_t new_size;
     bool bad_alpha;
 
-    liqattr = liq_attr_create();
+    liqattr = liq_attr_create_with_allocator(memory_alloc, memory_free);
     if (liqattr == NULL)
     {
         LOG_ERROR("Failed to create image attributes \'%s\'\n", image->path);
@@ -540,10 +1865,12 @@ int image_quantize(struct image *image, const struct palette *palette)
         return -1;
     }
 
+    stats_quantize();
+
     liq_set_dithering_level(liqresult, image->dither);
 
     new_size = image->width * image->height;
-    new_data = memory_alloc(new_size);
+    new_data = memory_scratch_alloc(new_size);
     if (new_data == NULL)
     {
         liq_result_destroy(liqresult);
@@ -592,7 +1919,7 @@ int image_quantize(struct image *image, const struct palette *palette)
     liq_image_destroy(liqimage);
     liq_attr_destroy(liqattr);
 
-    free(image->data);
+    memory_free(image->data);
     image->data = new_data;
     image->data_size = new_size;
 
@@ -623,7 +1950,7 @@ int image_direct_convert(struct image *image, color_format_t fmt)
             return -1;
     }
 
-    new_data = memory_alloc(new_size);
+    new_data = memory_scratch_alloc(new_size);
     if (new_data == NULL)
     {
         return -1;
@@ -689,7 +2016,7 @@ int image_direct_convert(struct image *image, color_format_t fmt)
         }
     }
 
-    free(image->data);
+    memory_free(image->data);
     image->data = new_data;
     image->data_size = new_size;
 
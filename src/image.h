@@ -44,6 +44,41 @@ extern "C" {
 
 struct palette;
 
+typedef enum
+{
+    IMAGE_TRANSFORM_NONE,
+    IMAGE_TRANSFORM_FLIP_X,
+    IMAGE_TRANSFORM_FLIP_Y,
+    IMAGE_TRANSFORM_ROT_90,
+    IMAGE_TRANSFORM_ROT_180,
+    IMAGE_TRANSFORM_ROT_270,
+    IMAGE_TRANSFORM_TRANSPOSE,
+    IMAGE_TRANSFORM_TRANSVERSE,
+} image_transform_t;
+
+#define IMAGE_MAX_TRANSFORMS 8
+#define IMAGE_DELTA_SPAN_HEADER 4
+#define IMAGE_DELTA_MAX_SPAN 255
+
+typedef enum
+{
+    IMAGE_LAYOUT_ROW_MAJOR,
+    IMAGE_LAYOUT_COLUMN_MAJOR,
+    IMAGE_LAYOUT_PADDED,
+} image_layout_t;
+
+typedef enum
+{
+    IMAGE_SCALE_BOX,
+    IMAGE_SCALE_LANCZOS,
+} image_scale_filter_t;
+
+#define IMAGE_MAX_SUB_PALETTE_ENTRIES 16
+
+/* compiled sprites draw into a buffer with the lcd row stride */
+#define IMAGE_COMPILED_STRIDE 320
+#define IMAGE_COMPILED_MIN_FILL 8
+
 struct image
 {
     /* assigned on init */
@@ -55,6 +90,13 @@ struct image
     uint32_t width;
     uint32_t height;
 
+    /* set when trimmed */
+    bool trimmed;
+    uint32_t trim_x;
+    uint32_t trim_y;
+    uint32_t orig_width;
+    uint32_t orig_height;
+
     /* set by convert */
     uint8_t transparent_index;
     uint32_t quantize_speed;
@@ -62,9 +104,47 @@ struct image
     bool gfx;
     bool compressed;
     bool rlet;
+    bool auto_rlet;
+    bool compiled;
+    bool preshift;
     bool flip_x;
     bool flip_y;
     float dither;
+    bpp_t bpp;
+    bool auto_bpp;
+
+    /* set when preshifted */
+    uint32_t nr_shifts;
+    uint32_t shift_width;
+    uint32_t shift_size;
+
+    /* set when bpp is automatically selected */
+    uint8_t sub_palette[IMAGE_MAX_SUB_PALETTE_ENTRIES];
+    uint32_t nr_sub_palette_entries;
+
+    /* set when the data is not tightly packed row-major */
+    image_layout_t layout;
+    uint32_t stride;
+
+    /* set when a collision mask is requested */
+    bool masked;
+    uint8_t *mask;
+    uint32_t mask_size;
+    uint32_t mask_stride;
+    bool mask_compressed;
+
+    /* set when the encoding is chosen by an appvar budget */
+    bool keep_indices;
+    uint8_t *indices;
+    bool auto_encoded;
+    compress_mode_t compress;
+};
+
+struct image_rlet_stats
+{
+    uint32_t size;
+    uint32_t nr_runs;
+    uint32_t nr_opaque;
 };
 
 #define WIDTH_HEIGHT_SIZE 2
@@ -73,8 +153,12 @@ void image_init(struct image *image, const char *path);
 
 int image_load(struct image *image);
 
+int image_trim(struct image *image, uint32_t align);
+
 int image_rlet(struct image *image, uint8_t transparent_index);
 
+int image_compile(struct image *image, uint8_t transparent_index);
+
 int image_add_width_and_height(struct image *image);
 
 int image_add_offset(struct image *image, uint8_t offset);
@@ -83,8 +167,24 @@ int image_compress(struct image *image, compress_mode_t mode);
 
 int image_remove_omits(struct image *image, const uint8_t *omit_indices, uint32_t nr_omit_indices);
 
+int image_delta(struct image *image, const uint8_t *prev);
+
+int image_set_layout(struct image *image, image_layout_t layout, uint32_t stride);
+
+int image_build_mask(struct image *image, bool direct, uint8_t transparent_index);
+
 int image_set_bpp(struct image *image, bpp_t bpp, uint32_t palette_nr_entries);
 
+int image_preshift(struct image *image, bpp_t bpp, uint32_t nr_palette_entries, uint8_t pad_index);
+
+bpp_t image_min_bpp(const struct image *image);
+
+int image_auto_bpp(struct image *image);
+
+void image_rlet_stats(const struct image *image, uint8_t transparent_index, struct image_rlet_stats *stats);
+
+uint32_t image_bpp_bits(bpp_t bpp);
+
 int image_quantize(struct image *image, const struct palette *palette);
 
 int image_direct_convert(struct image *image, color_format_t fmt);
@@ -97,6 +197,12 @@ void image_flip_x(uint32_t *data, uint32_t width, uint32_t height);
 
 int image_rotate_90(uint32_t *data, uint32_t width, uint32_t height);
 
+int image_transform(struct image *image, image_transform_t transform, uint32_t pixel_size);
+
+int image_rotate_frames(struct image *image, uint32_t nr_frames);
+
+int image_scale(struct image *image, uint32_t width, uint32_t height, image_scale_filter_t filter);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,7 @@
 #include "log.h"
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #ifdef _WIN32
@@ -39,6 +40,8 @@
 
 #define COLOR_RESET "\e[0m"
 
+#define LOG_BUFFER_SIZE 8192
+
 static const char *color_strings[] =
 {
     NULL,
@@ -63,11 +66,47 @@ static struct
     bool colors;
 } log;
 
+/* messages inside a group are collected per thread and written out in one call */
+static _Thread_local struct
+{
+    char data[LOG_BUFFER_SIZE];
+    size_t len;
+    unsigned int depth;
+} log_buffer;
+
+static bool log_vappend(size_t *pos, const char *str, va_list arglist)
+{
+    size_t avail = LOG_BUFFER_SIZE - *pos;
+    int len = vsnprintf(&log_buffer.data[*pos], avail, str, arglist);
+
+    if (len < 0 || (size_t)len >= avail)
+    {
+        return false;
+    }
+
+    *pos += len;
+    return true;
+}
+
+static bool log_append(size_t *pos, const char *str, ...)
+{
+    va_list arglist;
+    bool ret;
+
+    va_start(arglist, str);
+    ret = log_vappend(pos, str, arglist);
+    va_end(arglist);
+
+    return ret;
+}
+
 void log_init(void)
 {
     log.level = LOG_BUILD_LEVEL;
     log.colors = isatty(1);
 
+    atexit(log_flush);
+
 #ifdef _WIN32
     HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
     if (handle != INVALID_HANDLE_VALUE)
@@ -92,32 +131,110 @@ void log_set_color(bool colors)
     log.colors = colors;
 }
 
+void log_flush(void)
+{
+    if (log_buffer.len != 0)
+    {
+        fwrite(log_buffer.data, 1, log_buffer.len, stdout);
+        fflush(stdout);
+        log_buffer.len = 0;
+    }
+}
+
+void log_group_begin(void)
+{
+    log_buffer.depth++;
+}
+
+void log_group_end(void)
+{
+    if (log_buffer.depth != 0 && --log_buffer.depth == 0)
+    {
+        log_flush();
+    }
+}
+
+/* writes straight to stdout, after anything already buffered */
+static void log_vwrite(const char *color, const char *prefix, const char *str, va_list arglist)
+{
+    log_flush();
+
+    if (color)
+    {
+        fputs(color, stdout);
+    }
+
+    if (prefix)
+    {
+        fprintf(stdout, "[%s] ", prefix);
+    }
+
+    vfprintf(stdout, str, arglist);
+
+    if (color)
+    {
+        fputs(COLOR_RESET, stdout);
+    }
+
+    fflush(stdout);
+}
+
 void log_msg(log_level_t level, const char *str, ...)
 {
     if (level <= LOG_BUILD_LEVEL && level <= log.level)
     {
+        const char *color = log.colors ? color_strings[level] : NULL;
         va_list arglist;
+        bool fit = false;
 
-        if (log.colors && color_strings[level])
+        /* retry once into an empty buffer */
+        for (int attempt = 0; attempt < 2 && log_buffer.depth != 0; ++attempt)
         {
-            fputs(color_strings[level], stdout);
-        }
+            size_t pos = log_buffer.len;
 
-        fprintf(stdout, "[%s] ", log_strings[level]);
+            fit = true;
 
-        va_start(arglist, str);
-        vfprintf(stdout, str, arglist);
-        va_end(arglist);
+            if (color)
+            {
+                fit = log_append(&pos, "%s", color);
+            }
+
+            fit = fit && log_append(&pos, "[%s] ", log_strings[level]);
+
+            va_start(arglist, str);
+            fit = fit && log_vappend(&pos, str, arglist);
+            va_end(arglist);
+
+            if (color)
+            {
+                fit = fit && log_append(&pos, "%s", COLOR_RESET);
+            }
+
+            if (fit)
+            {
+                log_buffer.len = pos;
+                break;
+            }
 
-        if (log.colors && color_strings[level])
+            log_flush();
+        }
+
+        /* outside a group, or too large for the buffer */
+        if (!fit)
         {
-            fputs(COLOR_RESET, stdout);
+            va_start(arglist, str);
+            log_vwrite(color, log_strings[level], str, arglist);
+            va_end(arglist);
         }
 
-        fflush(stdout);
+        if (level == LOG_LVL_ERROR)
+        {
+            log_flush();
+        }
     }
 }
 
+/* unbuffered, so progress output shows up as it is printed */
 void log_printf(const char *str, ...)
 {
     if (LOG_LVL_INFO <= LOG_BUILD_LEVEL && LOG_LVL_INFO <= log.level)
@@ -125,9 +242,7 @@ void log_printf(const char *str, ...)
         va_list arglist;
 
         va_start(arglist, str);
-        vfprintf(stdout, str, arglist);
+        log_vwrite(NULL, NULL, str, arglist);
         va_end(arglist);
-
-        fflush(stdout);
     }
 }
@@ -76,6 +76,12 @@ void log_msg(log_level_t level, const char *str, ...);
 
 void log_printf(const char *str, ...);
 
+void log_flush(void);
+
+void log_group_begin(void);
+
+void log_group_end(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,27 +33,244 @@
 #include "clean.h"
 #include "icon.h"
 #include "parser.h"
+#include "profile.h"
+#include "memory.h"
+#include "stats.h"
 #include "log.h"
 
-static int process_yaml(struct yaml *yaml)
+static int process_convert(struct yaml *yaml, struct convert *convert)
 {
+    memory_tag_t tag;
+    int ret;
+
+    log_group_begin();
+    stats_begin_convert(convert->name);
+    profile_begin("convert", convert->name);
+    tag = memory_set_tag(MEMORY_TAG_ENCODE);
+    ret = convert_generate(
+        convert,
+        yaml->palettes,
+        &yaml->palette_registry);
+    memory_set_tag(tag);
+    profile_end("convert", convert->name);
+    stats_end_convert();
+    log_group_end();
+
+    return ret;
+}
+
+static int process_output(struct yaml *yaml, struct output *output)
+{
+    memory_tag_t tag;
+    int ret;
+
+    log_group_begin();
+    /* appvars all default to the same include file, so use their names */
+    switch (output->format)
+    {
+        case OUTPUT_FORMAT_C:
+            stats_begin_output("c", output->include_file);
+            break;
+        case OUTPUT_FORMAT_ASM:
+            stats_begin_output("asm", output->include_file);
+            break;
+        case OUTPUT_FORMAT_BASIC:
+            stats_begin_output("basic", output->include_file);
+            break;
+        case OUTPUT_FORMAT_APPVAR:
+            stats_begin_output("appvar", output->appvar.name);
+            break;
+        case OUTPUT_FORMAT_BIN:
+            stats_begin_output("bin", output->include_file);
+            break;
+        default:
+            stats_begin_output("", output->include_file);
+            break;
+    }
+    profile_begin("output", output->include_file);
+    tag = memory_set_tag(MEMORY_TAG_OUTPUT);
+    ret = output_generate(
+        output,
+        yaml->palettes,
+        &yaml->palette_registry,
+        yaml->converts,
+        &yaml->convert_registry);
+    memory_set_tag(tag);
+    profile_end("output", output->include_file);
+    stats_end_output();
+    log_group_end();
+
+    return ret;
+}
+
+static int find_convert(struct yaml *yaml, const char *name)
+{
+    uint32_t index;
+
+    if (registry_find(&yaml->convert_registry, name, &index))
+    {
+        return -1;
+    }
+
+    return (int)index;
+}
+
+/*
+ * Converts are only generated once an output needs them, and their data is
+ * released as soon as the last output referencing them has been written,
+ * so at most one output's worth of converted data is held at a time.
+ */
+static int process_streaming(struct yaml *yaml)
+{
+    uint32_t *refs = NULL;
+    bool *generated = NULL;
+
+    if (yaml->nr_converts == 0)
+    {
+        goto outputs;
+    }
+
+    refs = memory_realloc_array(NULL, yaml->nr_converts, sizeof(uint32_t));
+    generated = memory_realloc_array(NULL, yaml->nr_converts, sizeof(bool));
+    if (refs == NULL || generated == NULL)
+    {
+        goto error;
+    }
+
+    for (uint32_t i = 0; i < yaml->nr_converts; ++i)
+    {
+        refs[i] = 0;
+        generated[i] = false;
+    }
+
+    for (uint32_t i = 0; i < yaml->nr_outputs; ++i)
+    {
+        const struct output *output = yaml->outputs[i];
+
+        for (uint32_t j = 0; j < output->nr_converts; ++j)
+        {
+            int idx = find_convert(yaml, output->convert_names[j]);
+            if (idx >= 0)
+            {
+                refs[idx]++;
+            }
+        }
+    }
+
+outputs:
+    for (uint32_t i = 0; i < yaml->nr_outputs; ++i)
+    {
+        struct output *output = yaml->outputs[i];
+
+        for (uint32_t j = 0; j < output->nr_converts; ++j)
+        {
+            int idx = find_convert(yaml, output->convert_names[j]);
+            if (idx < 0 || generated[idx])
+            {
+                continue;
+            }
+
+            if (process_convert(yaml, yaml->converts[idx]))
+            {
+                goto error;
+            }
+
+            generated[idx] = true;
+        }
+
+        if (process_output(yaml, output))
+        {
+            goto error;
+        }
+
+        for (uint32_t j = 0; j < output->nr_converts; ++j)
+        {
+            int idx = find_convert(yaml, output->convert_names[j]);
+            if (idx >= 0 && --refs[idx] == 0)
+            {
+                convert_release(yaml->converts[idx]);
+            }
+        }
+    }
+
+    /* converts no output uses are still checked for errors */
+    for (uint32_t i = 0; i < yaml->nr_converts; ++i)
+    {
+        if (generated[i])
+        {
+            continue;
+        }
+
+        if (process_convert(yaml, yaml->converts[i]))
+        {
+            goto error;
+        }
+
+        convert_release(yaml->converts[i]);
+    }
+
+    memory_free(generated);
+    memory_free(refs);
+    return 0;
+
+error:
+    memory_free(generated);
+    memory_free(refs);
+    return -1;
+}
+
+static int process_yaml(struct yaml *yaml, bool streaming)
+{
+    memory_tag_t tag;
+    int ret;
+
     for (uint32_t i = 0; i < yaml->nr_palettes; ++i)
     {
-        if (palette_generate(
+        log_group_begin();
+        profile_begin("palette", yaml->palettes[i]->name);
+        tag = memory_set_tag(MEMORY_TAG_PALETTE);
+        ret = palette_generate(
             yaml->palettes[i],
             yaml->converts,
-            yaml->nr_converts))
+            yaml->nr_converts);
+        memory_set_tag(tag);
+        profile_end("palette", yaml->palettes[i]->name);
+        log_group_end();
+        if (ret)
         {
             return -1;
         }
+
+        stats_palette(yaml->palettes[i]);
     }
 
-    for (uint32_t i = 0; i < yaml->nr_converts; ++i)
+    /* remaps may target any palette, so run once all are generated */
+    for (uint32_t i = 0; i < yaml->nr_palettes; ++i)
     {
-        if (convert_generate(
-            yaml->converts[i],
+        log_group_begin();
+        profile_begin("remaps", yaml->palettes[i]->name);
+        tag = memory_set_tag(MEMORY_TAG_PALETTE);
+        ret = palette_generate_remaps(
+            yaml->palettes[i],
             yaml->palettes,
-            yaml->nr_palettes))
+            yaml->nr_palettes);
+        memory_set_tag(tag);
+        profile_end("remaps", yaml->palettes[i]->name);
+        log_group_end();
+        if (ret)
+        {
+            return -1;
+        }
+    }
+
+    if (streaming)
+    {
+        return process_streaming(yaml);
+    }
+
+    for (uint32_t i = 0; i < yaml->nr_converts; ++i)
+    {
+        if (process_convert(yaml, yaml->converts[i]))
         {
             return -1;
         }
@@ -61,12 +278,7 @@ static int process_yaml(struct yaml *yaml)
 
     for (uint32_t i = 0; i < yaml->nr_outputs; ++i)
     {
-        if (output_generate(
-            yaml->outputs[i],
-            yaml->palettes,
-            yaml->nr_palettes,
-            yaml->converts,
-            yaml->nr_converts))
+        if (process_output(yaml, yaml->outputs[i]))
         {
             return -1;
         }
@@ -105,6 +317,8 @@ int main(int argc, char *argv[])
 
         ret = clean_begin(options.yaml_path, CLEAN_CREATE);
 
+        stats_init(options.stats);
+
         if (!ret)
         {    
             ret = parser_open(&yaml, options.yaml_path);
@@ -112,15 +326,30 @@ int main(int argc, char *argv[])
 
         if (!ret)
         {
-            ret = process_yaml(&yaml);
+            profile_init(options.profile_path);
+            memory_set_limit(options.max_memory);
+
+            ret = process_yaml(&yaml, options.max_memory != 0);
             if (!ret)
             {
                 LOG_PRINT("[success] Generated file listing \'%s.lst\'\n", options.yaml_path);
             }
+
+            if (profile_finish())
+            {
+                ret = -1;
+            }
         }
 
+        stats_finish();
+
         parser_close(&yaml);
 
+        if (options.mem_stats)
+        {
+            memory_report();
+        }
+
         clean_end();
     }
 
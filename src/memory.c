@@ -31,11 +31,297 @@
 #include "memory.h"
 #include "log.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 
+/* every block is prefixed with its size and tag so frees can be credited */
+union memory_header
+{
+    struct
+    {
+        size_t size;
+        memory_tag_t tag;
+    } info;
+    max_align_t align;
+};
+
+/* scratch blocks are bumped out of chunks that are kept for reuse */
+struct memory_chunk
+{
+    struct memory_chunk *next;
+    size_t base;
+    size_t size;
+    size_t used;
+};
+
+#define MEMORY_ALIGN(x) \
+    ((((x) + sizeof(union memory_header) - 1) / sizeof(union memory_header)) * sizeof(union memory_header))
+
+#define MEMORY_CHUNK_DATA(chunk) \
+    ((unsigned char *)(chunk) + MEMORY_ALIGN(sizeof(struct memory_chunk)))
+
+#define MEMORY_CHUNK_MIN_SIZE (256 * 1024)
+
+struct memory_stats
+{
+    size_t live;
+    size_t peak;
+    uint64_t count;
+};
+
+static const char *memory_tag_names[MEMORY_NR_TAGS] =
+{
+    "other",
+    "decode",
+    "palette",
+    "quantize",
+    "encode",
+    "compress",
+    "output",
+    "scratch",
+};
+
+static struct
+{
+    size_t limit;
+    memory_tag_t tag;
+    struct memory_stats tags[MEMORY_NR_TAGS];
+    struct memory_stats total;
+    struct memory_chunk *chunks;
+    struct memory_chunk *chunk;
+    uint32_t scratch_depth;
+} memory;
+
+static void memory_stats_add(struct memory_stats *stats, size_t size)
+{
+    stats->live += size;
+    stats->count++;
+    if (stats->live > stats->peak)
+    {
+        stats->peak = stats->live;
+    }
+}
+
+static void memory_release(memory_tag_t tag, size_t size)
+{
+    memory.tags[tag].live -= size;
+    memory.total.live -= size;
+}
+
+static struct memory_chunk *memory_scratch_chunk(const void *ptr)
+{
+    for (struct memory_chunk *chunk = memory.chunks; chunk != NULL; chunk = chunk->next)
+    {
+        uintptr_t data = (uintptr_t)MEMORY_CHUNK_DATA(chunk);
+
+        if ((uintptr_t)ptr >= data && (uintptr_t)ptr < data + chunk->size)
+        {
+            return chunk;
+        }
+    }
+
+    return NULL;
+}
+
+static struct memory_chunk *memory_scratch_new_chunk(struct memory_chunk *prev, size_t need)
+{
+    struct memory_chunk *chunk;
+    size_t size = MEMORY_CHUNK_MIN_SIZE;
+    size_t bytes;
+
+    if (prev != NULL && prev->size > size)
+    {
+        size = prev->size;
+    }
+
+    while (size < need)
+    {
+        size *= 2;
+    }
+
+    bytes = MEMORY_ALIGN(sizeof(struct memory_chunk)) + size;
+
+    if (memory.limit != 0 && memory.total.live + bytes > memory.limit)
+    {
+        return NULL;
+    }
+
+    chunk = malloc(bytes);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->base = prev != NULL ? prev->base + prev->size : 0;
+    chunk->size = size;
+    chunk->used = 0;
+
+    memory_stats_add(&memory.tags[MEMORY_TAG_SCRATCH], bytes);
+    memory_stats_add(&memory.total, bytes);
+
+    return chunk;
+}
+
+static void memory_scratch_free_chunks(struct memory_chunk *chunk)
+{
+    while (chunk != NULL)
+    {
+        struct memory_chunk *next = chunk->next;
+
+        memory_release(MEMORY_TAG_SCRATCH, MEMORY_ALIGN(sizeof(struct memory_chunk)) + chunk->size);
+        free(chunk);
+
+        chunk = next;
+    }
+}
+
+static void *memory_scratch_bump(size_t size)
+{
+    struct memory_chunk *chunk = memory.chunk;
+    union memory_header *header;
+    size_t need;
+
+    if (size > SIZE_MAX / 4)
+    {
+        return NULL;
+    }
+
+    need = MEMORY_ALIGN(sizeof(union memory_header) + size);
+
+    while (chunk == NULL || chunk->size - chunk->used < need)
+    {
+        struct memory_chunk *next = chunk != NULL ? chunk->next : NULL;
+
+        if (next != NULL && next->size >= need)
+        {
+            chunk = next;
+            continue;
+        }
+
+        /* later chunks are too small to help, so swap in one that fits */
+        memory_scratch_free_chunks(next);
+
+        next = memory_scratch_new_chunk(chunk, need);
+        if (next == NULL)
+        {
+            if (chunk != NULL)
+            {
+                chunk->next = NULL;
+            }
+            return NULL;
+        }
+
+        if (chunk != NULL)
+        {
+            chunk->next = next;
+        }
+        else
+        {
+            memory.chunks = next;
+        }
+
+        chunk = next;
+    }
+
+    header = (union memory_header *)(MEMORY_CHUNK_DATA(chunk) + chunk->used);
+    header->info.size = size;
+    header->info.tag = MEMORY_TAG_SCRATCH;
+
+    chunk->used += need;
+    memory.chunk = chunk;
+
+    return header + 1;
+}
+
+/* the newest block grows in place, anything else moves to a new block */
+static void *memory_scratch_resize(struct memory_chunk *chunk, void *ptr, size_t size)
+{
+    union memory_header *header = (union memory_header *)ptr - 1;
+    size_t old_size = header->info.size;
+    size_t start = (unsigned char *)header - MEMORY_CHUNK_DATA(chunk);
+    void *mem;
+
+    if (chunk == memory.chunk &&
+        start + MEMORY_ALIGN(sizeof(union memory_header) + old_size) == chunk->used &&
+        size <= SIZE_MAX / 4 &&
+        MEMORY_ALIGN(sizeof(union memory_header) + size) <= chunk->size - start)
+    {
+        chunk->used = start + MEMORY_ALIGN(sizeof(union memory_header) + size);
+        header->info.size = size;
+        return ptr;
+    }
+
+    if (memory.scratch_depth != 0)
+    {
+        mem = memory_scratch_bump(size);
+    }
+    else
+    {
+        mem = memory_lib_realloc(NULL, size);
+    }
+
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(mem, ptr, old_size < size ? old_size : size);
+
+    return mem;
+}
+
+/* follows the C library realloc: on failure the original block is kept */
+void *memory_lib_realloc(void *ptr, size_t size)
+{
+    union memory_header *header = NULL;
+    memory_tag_t tag = memory.tag;
+    size_t old_size = 0;
+
+    if (size > SIZE_MAX - sizeof(union memory_header))
+    {
+        return NULL;
+    }
+
+    if (ptr != NULL)
+    {
+        struct memory_chunk *chunk = memory_scratch_chunk(ptr);
+        if (chunk != NULL)
+        {
+            return memory_scratch_resize(chunk, ptr, size);
+        }
+
+        header = (union memory_header *)ptr - 1;
+        tag = header->info.tag;
+        old_size = header->info.size;
+    }
+
+    /* refuse to grow past the cap; callers treat it as out of memory */
+    if (memory.limit != 0 && size > old_size &&
+        memory.total.live - old_size + size > memory.limit)
+    {
+        return NULL;
+    }
+
+    header = realloc(header, sizeof(union memory_header) + size);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+
+    header->info.size = size;
+    header->info.tag = tag;
+
+    memory_release(tag, old_size);
+    memory_stats_add(&memory.tags[tag], size);
+    memory_stats_add(&memory.total, size);
+
+    return header + 1;
+}
+
 void *memory_alloc(size_t size)
 {
-    void *mem = malloc(size);
+    void *mem = memory_lib_realloc(NULL, size);
 
     if (mem == NULL)
     {
@@ -48,13 +334,13 @@ void *memory_alloc(size_t size)
 
 void *memory_realloc(void *ptr, size_t size)
 {
-    void *mem = realloc(ptr, size);
+    void *mem = memory_lib_realloc(ptr, size);
 
     /* normal realloc doesn't free on failure */
     if (mem == NULL)
     {
         LOG_ERROR("Out of memory.\n");
-        free(ptr);
+        memory_free(ptr);
         return NULL;
     }
 
@@ -68,9 +354,170 @@ void *memory_realloc_array(void *ptr, size_t nelem, size_t elsize)
     if (__builtin_mul_overflow(nelem, elsize, &bytes))
     {
         LOG_ERROR("Out of memory.\n");
-        free(ptr);
+        memory_free(ptr);
         return NULL;
     }
 
     return memory_realloc(ptr, bytes);
 }
+
+/* makes room for element nelem, doubling so repeated appends stay linear */
+void *memory_grow_array(void *ptr, uint32_t *nr_alloc, uint32_t nelem, size_t elsize)
+{
+    uint32_t nr = *nr_alloc < 8 ? 8 : *nr_alloc;
+
+    if (nelem < *nr_alloc)
+    {
+        return ptr;
+    }
+
+    while (nr <= nelem)
+    {
+        if (nr > UINT32_MAX / 2)
+        {
+            LOG_ERROR("Out of memory.\n");
+            memory_free(ptr);
+            *nr_alloc = 0;
+            return NULL;
+        }
+
+        nr *= 2;
+    }
+
+    ptr = memory_realloc_array(ptr, nr, elsize);
+    *nr_alloc = ptr != NULL ? nr : 0;
+
+    return ptr;
+}
+
+void memory_free(void *ptr)
+{
+    union memory_header *header;
+
+    /* scratch blocks are reclaimed when their scope is released */
+    if (ptr == NULL || memory_scratch_chunk(ptr) != NULL)
+    {
+        return;
+    }
+
+    header = (union memory_header *)ptr - 1;
+
+    memory_release(header->info.tag, header->info.size);
+
+    free(header);
+}
+
+/* allocations are credited to the current tag until it is changed back */
+memory_tag_t memory_set_tag(memory_tag_t tag)
+{
+    memory_tag_t prev = memory.tag;
+
+    memory.tag = tag;
+
+    return prev;
+}
+
+/*
+ * Scratch scopes nest: blocks from memory_scratch_alloc stay valid until the
+ * matching memory_scratch_release, after which their space is reused. Outside
+ * of any scope, scratch requests fall back to regular allocations.
+ */
+size_t memory_scratch_mark(void)
+{
+    memory.scratch_depth++;
+
+    return memory.chunk != NULL ? memory.chunk->base + memory.chunk->used : 0;
+}
+
+void memory_scratch_release(size_t mark)
+{
+    struct memory_chunk *chunk = memory.chunks;
+
+    memory.scratch_depth--;
+
+    while (chunk != NULL && mark > chunk->base + chunk->size)
+    {
+        chunk = chunk->next;
+    }
+
+    if (chunk == NULL)
+    {
+        return;
+    }
+
+    memory.chunk = chunk;
+    chunk->used = mark - chunk->base;
+
+    for (chunk = chunk->next; chunk != NULL; chunk = chunk->next)
+    {
+        chunk->used = 0;
+    }
+}
+
+void *memory_scratch_alloc(size_t size)
+{
+    void *mem;
+
+    if (memory.scratch_depth == 0)
+    {
+        return memory_alloc(size);
+    }
+
+    mem = memory_scratch_bump(size);
+    if (mem == NULL)
+    {
+        LOG_ERROR("Out of memory.\n");
+        return NULL;
+    }
+
+    return mem;
+}
+
+/* moves the first size bytes of a scratch block into long-lived memory */
+void *memory_persist(void *ptr, size_t size)
+{
+    void *mem;
+
+    if (ptr == NULL || memory_scratch_chunk(ptr) == NULL)
+    {
+        return ptr;
+    }
+
+    mem = memory_alloc(size);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(mem, ptr, size);
+
+    return mem;
+}
+
+/* a limit of zero removes the cap */
+void memory_set_limit(size_t limit)
+{
+    memory.limit = limit;
+}
+
+void memory_report(void)
+{
+    LOG_PRINT("[memory] %-10s %10s %12s %12s\n", "tag", "allocs", "peak KiB", "live KiB");
+
+    for (uint32_t i = 0; i < MEMORY_NR_TAGS; ++i)
+    {
+        const struct memory_stats *stats = &memory.tags[i];
+
+        LOG_PRINT("[memory] %-10s %10llu %12.1f %12.1f\n",
+            memory_tag_names[i],
+            (unsigned long long)stats->count,
+            stats->peak / 1024.0,
+            stats->live / 1024.0);
+    }
+
+    LOG_PRINT("[memory] %-10s %10llu %12.1f %12.1f\n",
+        "total",
+        (unsigned long long)memory.total.count,
+        memory.total.peak / 1024.0,
+        memory.total.live / 1024.0);
+}
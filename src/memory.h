@@ -38,12 +38,45 @@
 extern "C" {
 #endif
 
+typedef enum
+{
+    MEMORY_TAG_OTHER,
+    MEMORY_TAG_DECODE,
+    MEMORY_TAG_PALETTE,
+    MEMORY_TAG_QUANTIZE,
+    MEMORY_TAG_ENCODE,
+    MEMORY_TAG_COMPRESS,
+    MEMORY_TAG_OUTPUT,
+    MEMORY_TAG_SCRATCH,
+    MEMORY_NR_TAGS,
+} memory_tag_t;
+
 void *memory_alloc(size_t size);
 
 void *memory_realloc(void *ptr, size_t size);
 
 void *memory_realloc_array(void *ptr, size_t nelem, size_t elsize);
 
+void *memory_grow_array(void *ptr, uint32_t *nr_alloc, uint32_t nelem, size_t elsize);
+
+void memory_free(void *ptr);
+
+void *memory_lib_realloc(void *ptr, size_t size);
+
+size_t memory_scratch_mark(void);
+
+void memory_scratch_release(size_t mark);
+
+void *memory_scratch_alloc(size_t size);
+
+void *memory_persist(void *ptr, size_t size);
+
+memory_tag_t memory_set_tag(memory_tag_t tag);
+
+void memory_set_limit(size_t limit);
+
+void memory_report(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,7 @@
 
 #include <getopt.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <errno.h>
 
@@ -55,6 +56,21 @@ static void options_show(const char *prgm)
     LOG_PRINT("    -c, --clean              Deletes files listed in \'convimg.out\' and exits.\n");
     LOG_PRINT("    -l, --log-level <level>  Set program logging level:\n");
     LOG_PRINT("                             0=none, 1=error, 2=warning, 3=normal\n");
+    LOG_PRINT("    -p, --profile <file>     Write a Chrome trace of each stage (decode,\n");
+    LOG_PRINT("                             quantize, encode, compress, write) to <file>\n");
+    LOG_PRINT("                             and print a per-stage summary on exit.\n");
+    LOG_PRINT("    -m, --mem-stats          Print allocation counts and peak/live bytes\n");
+    LOG_PRINT("                             per subsystem (decode, palette, quantize,\n");
+    LOG_PRINT("                             encode, compress, output) on exit.\n");
+    LOG_PRINT("    -M, --max-memory <MiB>   Generate each convert only when an output needs\n");
+    LOG_PRINT("                             it and release it once written, failing rather\n");
+    LOG_PRINT("                             than exceeding <MiB> of live allocations.\n");
+    LOG_PRINT("    -s, --stats <format>     Print run counters on exit as \'text\' or \'json\':\n");
+    LOG_PRINT("                             pixels decoded, quantizations, bytes in/out,\n");
+    LOG_PRINT("                             ratio and time per encoding stage and codec,\n");
+    LOG_PRINT("                             unique source colors per palette, files and\n");
+    LOG_PRINT("                             bytes per output, with a breakdown per convert.\n");
+    LOG_PRINT("                             json is written even with --log-level 0.\n");
     LOG_PRINT("Optional icon options:\n");
     LOG_PRINT("    --icon <file>            Create an icon for use by shell.\n");
     LOG_PRINT("    --icon-description <txt> Specify icon/program description.\n");
@@ -155,6 +171,48 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : less palette entries.\n");
     LOG_PRINT("                                  : Default is 8.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       fades: <count>             : Output <count> fade steps of the palette\n");
+    LOG_PRINT("                                  : as \'<palette>_fades\', where step n\n");
+    LOG_PRINT("                                  : (starting at 0) blends every color\n");
+    LOG_PRINT("                                  : (n + 1) / <count> of the way to\n");
+    LOG_PRINT("                                  : \'fade-color\'. Each step has the size\n");
+    LOG_PRINT("                                  : of the palette, so a fade on device is\n");
+    LOG_PRINT("                                  : a single copy. In binary and AppVar\n");
+    LOG_PRINT("                                  : outputs the steps directly follow the\n");
+    LOG_PRINT("                                  : palette. Range is 1-64.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       fade-color: <color>        : Color that \'fades\' blend toward. Can be\n");
+    LOG_PRINT("                                  : \'black\', \'white\', a \'#RRGGBB\' hex\n");
+    LOG_PRINT("                                  : string, or {r: <r>, g: <g>, b: <b>}.\n");
+    LOG_PRINT("                                  : Default is \'black\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       remaps:                    : Adds index translation tables for\n");
+    LOG_PRINT("                                  : recoloring images using this palette at\n");
+    LOG_PRINT("                                  : runtime. The format is:\n");
+    LOG_PRINT("                                  :\n");
+    LOG_PRINT("                                  :  remaps:\n");
+    LOG_PRINT("                                  :    - name: flash\n");
+    LOG_PRINT("                                  :      transform: tint\n");
+    LOG_PRINT("                                  :      color: white\n");
+    LOG_PRINT("                                  :      keep-indices: [0]\n");
+    LOG_PRINT("                                  :    - name: red_team\n");
+    LOG_PRINT("                                  :      palette: redpalette\n");
+    LOG_PRINT("                                  :\n");
+    LOG_PRINT("                                  : Each table has 256 entries, one for each\n");
+    LOG_PRINT("                                  : palette index, holding the index of the\n");
+    LOG_PRINT("                                  : nearest color in \'palette\' (default is\n");
+    LOG_PRINT("                                  : this palette) after the \'transform\' is\n");
+    LOG_PRINT("                                  : applied. Transforms are \'none\',\n");
+    LOG_PRINT("                                  : \'grayscale\', \'invert\' and \'tint\', which\n");
+    LOG_PRINT("                                  : blends \'amount\' percent (default 100)\n");
+    LOG_PRINT("                                  : toward \'color\', given in the same forms\n");
+    LOG_PRINT("                                  : as \'fade-color\'. \'keep-indices\', such as\n");
+    LOG_PRINT("                                  : the transparent index, and unused\n");
+    LOG_PRINT("                                  : entries map to themselves. Tables are\n");
+    LOG_PRINT("                                  : output alongside the palette, directly\n");
+    LOG_PRINT("                                  : after it (and its fades) in binary and\n");
+    LOG_PRINT("                                  : AppVar outputs.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       images: <option>           : A list of images separated by a newline\n");
     LOG_PRINT("                                  : and indented with a leading \'-\'\n");
     LOG_PRINT("                                  : character. These images are quantized\n");
@@ -219,6 +277,19 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  :   \'tile-flip-y\': flip tiles across y axis.\n");
     LOG_PRINT("                                  :   \'pointer-table\': output tile pointers\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       palette-banks: <count>     : Splits the palette into up to <count>\n");
+    LOG_PRINT("                                  : banks of 16 indices and packs each tile\n");
+    LOG_PRINT("                                  : at 4 bpp against one bank. Tiles that\n");
+    LOG_PRINT("                                  : share colors share a bank; a tile whose\n");
+    LOG_PRINT("                                  : colors do not fit takes the nearest\n");
+    LOG_PRINT("                                  : bank colors. Local index 0 is always\n");
+    LOG_PRINT("                                  : the transparent index. Outputs\n");
+    LOG_PRINT("                                  : \'_nr_banks\', \'_banks\' (16 palette\n");
+    LOG_PRINT("                                  : indices per bank) and \'_tile_banks\' (a\n");
+    LOG_PRINT("                                  : bank per tile). Maximum is 16. Only\n");
+    LOG_PRINT("                                  : applies to tilesets with the palette\n");
+    LOG_PRINT("                                  : style, and only C and assembly outputs.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       transparent-index: <index> : Transparent color index in the palette\n");
     LOG_PRINT("                                  : that represents a transparent color.\n");
     LOG_PRINT("                                  : This only is used in two cases!\n");
@@ -247,8 +318,33 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : converts the input image colors to the\n");
     LOG_PRINT("                                  : desired format. This may prevent some\n");
     LOG_PRINT("                                  : palette-specific options from being used.\n");
+    LOG_PRINT("                                  : In \'auto\' mode, each image is encoded\n");
+    LOG_PRINT("                                  : both as \'palette\' and \'rlet\', and the\n");
+    LOG_PRINT("                                  : better one is chosen per image based\n");
+    LOG_PRINT("                                  : on the \'style-objective\' option.\n");
+    LOG_PRINT("                                  : Tilesets use \'palette\' in this mode.\n");
+    LOG_PRINT("                                  : In \'compiled\' mode, each image becomes\n");
+    LOG_PRINT("                                  : an ez80 routine that stores only its\n");
+    LOG_PRINT("                                  : opaque pixels. Call it with a pointer to\n");
+    LOG_PRINT("                                  : the top left destination pixel in a 320\n");
+    LOG_PRINT("                                  : pixel wide buffer. Drawing is not\n");
+    LOG_PRINT("                                  : clipped. Tilesets are not supported.\n");
     LOG_PRINT("                                  : Default is \'palette\'.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       style-objective: <mode>    : Controls how the \'auto\' style chooses\n");
+    LOG_PRINT("                                  : between \'palette\' and \'rlet\'. In\n");
+    LOG_PRINT("                                  : \'size\' mode the smaller output is\n");
+    LOG_PRINT("                                  : chosen. In \'speed\' mode the output\n");
+    LOG_PRINT("                                  : with the lower estimated ez80 drawing\n");
+    LOG_PRINT("                                  : time is chosen.\n");
+    LOG_PRINT("                                  : Default is \'size\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       decode-weight: <float>     : Weight of this convert\'s images in the\n");
+    LOG_PRINT("                                  : estimated decode time used by an AppVar\n");
+    LOG_PRINT("                                  : \'budget\'. Higher values keep the images\n");
+    LOG_PRINT("                                  : faster to decode at the cost of size.\n");
+    LOG_PRINT("                                  : Default is \'1\'.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       color-format: <format>     : In direct style mode, sets the colorspace\n");
     LOG_PRINT("                                  : for the converted pixels. The available\n");
     LOG_PRINT("                                  : options are \'rgb565\', \'bgr565\', \'rgb888\',\n");
@@ -273,6 +369,54 @@ static void options_show(const char *prgm)
     LOG_PRINT("\n");
     LOG_PRINT("       rotate: <degrees>          : Rotate input images 0, 90, 180, 270 degrees\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       variants: [<list>]         : Output each image in several\n");
+    LOG_PRINT("                                  : orientations, loading and quantizing\n");
+    LOG_PRINT("                                  : it only once. Available variants are\n");
+    LOG_PRINT("                                  : \'none\', \'flip-x\', \'flip-y\', \'rot90\',\n");
+    LOG_PRINT("                                  : \'rot180\', \'rot270\', \'transpose\' and\n");
+    LOG_PRINT("                                  : \'transverse\', applied after the\n");
+    LOG_PRINT("                                  : options above. Each variant is output\n");
+    LOG_PRINT("                                  : with the variant name as a suffix,\n");
+    LOG_PRINT("                                  : e.g. \'image_rot90\', except \'none\'\n");
+    LOG_PRINT("                                  : which keeps the image name.\n");
+    LOG_PRINT("                                  : Only applies to images, not tilesets.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       scales: [<list>]           : Output each image resampled at several\n");
+    LOG_PRINT("                                  : scales, e.g. [1, 2, 0.5], decoding it\n");
+    LOG_PRINT("                                  : only once. Scaling happens before\n");
+    LOG_PRINT("                                  : quantization, so blended colors are\n");
+    LOG_PRINT("                                  : matched to the palette. Each scale is\n");
+    LOG_PRINT("                                  : output with the scale as a suffix, e.g.\n");
+    LOG_PRINT("                                  : \'image_x2\' or \'image_x0_5\', except 1\n");
+    LOG_PRINT("                                  : which keeps the image name. Variants\n");
+    LOG_PRINT("                                  : are applied to each scaled image.\n");
+    LOG_PRINT("                                  : Transparency should come from alpha;\n");
+    LOG_PRINT("                                  : a color key is blended into edges.\n");
+    LOG_PRINT("                                  : Only applies to images, not tilesets.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       scale-filter: <filter>     : Filter used by \'scales\'. \'box\' averages\n");
+    LOG_PRINT("                                  : the covered pixels, which keeps hard\n");
+    LOG_PRINT("                                  : edges for integer upscales. \'lanczos\'\n");
+    LOG_PRINT("                                  : is smoother for photos and non-integer\n");
+    LOG_PRINT("                                  : scales. Default is \'box\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       rotations: <count>         : Resample each image at <count> evenly\n");
+    LOG_PRINT("                                  : spaced clockwise angles using a bicubic\n");
+    LOG_PRINT("                                  : filter. Every frame has one size large\n");
+    LOG_PRINT("                                  : enough for any angle, and the frames are\n");
+    LOG_PRINT("                                  : output as a tileset named after the image,\n");
+    LOG_PRINT("                                  : so the tile table indexes frames by angle.\n");
+    LOG_PRINT("                                  : Only applies to images, not tilesets.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       trim: <bool>               : Crop fully transparent rows and columns\n");
+    LOG_PRINT("                                  : from the edges of each image before\n");
+    LOG_PRINT("                                  : conversion. The offset of the cropped\n");
+    LOG_PRINT("                                  : image and the original dimensions are\n");
+    LOG_PRINT("                                  : output as \'_x_offset\', \'_y_offset\',\n");
+    LOG_PRINT("                                  : \'_orig_width\', and \'_orig_height\'.\n");
+    LOG_PRINT("                                  : Only applies to images, not tilesets.\n");
+    LOG_PRINT("                                  : Default is \'false\'.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       bpp: <bits-per-pixel>      : Map input pixels to number of output bits.\n");
     LOG_PRINT("                                  : Available options are 1, 2, 4, 8.\n");
     LOG_PRINT("                                  : For example, a value of 2 means that 1 pixel\n");
@@ -280,8 +424,84 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : The palette option \'max-entries\' should be\n");
     LOG_PRINT("                                  : used to limit the palette size for this\n");
     LOG_PRINT("                                  : option to ensure correct quantization.\n");
+    LOG_PRINT("                                  : A value of \'auto\' selects the smallest\n");
+    LOG_PRINT("                                  : bpp that fits the palette indices each\n");
+    LOG_PRINT("                                  : image actually uses. If those indices\n");
+    LOG_PRINT("                                  : are too large, the image is remapped to\n");
+    LOG_PRINT("                                  : a compact sub-palette, which is output\n");
+    LOG_PRINT("                                  : as \'_sub_palette\' along with the\n");
+    LOG_PRINT("                                  : selected \'_bpp\' for each image.\n");
+    LOG_PRINT("                                  : Tilesets select a single bpp based on\n");
+    LOG_PRINT("                                  : the number of palette entries.\n");
     LOG_PRINT("                                  : Default is \'8\'.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       masks: <bool>              : Output a 1 bpp collision mask for each\n");
+    LOG_PRINT("                                  : image as \'<image>_mask\', where set bits\n");
+    LOG_PRINT("                                  : are solid pixels. Pixels matching the\n");
+    LOG_PRINT("                                  : transparent index (or with zero alpha\n");
+    LOG_PRINT("                                  : for direct styles) are clear. Each row\n");
+    LOG_PRINT("                                  : is padded to \'<image>_mask_stride\'\n");
+    LOG_PRINT("                                  : bytes, with the leftmost pixel in the\n");
+    LOG_PRINT("                                  : high bit. Masks are compressed like the\n");
+    LOG_PRINT("                                  : images, as \'<image>_mask_compressed\'.\n");
+    LOG_PRINT("                                  : In AppVars the mask directly follows\n");
+    LOG_PRINT("                                  : the image data. Only available for C,\n");
+    LOG_PRINT("                                  : assembly and AppVar outputs, and only\n");
+    LOG_PRINT("                                  : applies to images, not tilesets.\n");
+    LOG_PRINT("                                  : Default is \'false\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       preshift: <bool>           : For images packed below 8 bpp, output a\n");
+    LOG_PRINT("                                  : copy shifted right by each pixel\n");
+    LOG_PRINT("                                  : position within a byte, so an image can\n");
+    LOG_PRINT("                                  : be drawn at any x with byte copies. The\n");
+    LOG_PRINT("                                  : copies share a padded width and are\n");
+    LOG_PRINT("                                  : output back to back, described by\n");
+    LOG_PRINT("                                  : \'_nr_shifts\', \'_shift_width\',\n");
+    LOG_PRINT("                                  : \'_shift_size\' and \'_shift(n)\'. Padding\n");
+    LOG_PRINT("                                  : uses the transparent index.\n");
+    LOG_PRINT("                                  : Only applies to images, not tilesets.\n");
+    LOG_PRINT("                                  : Default is \'false\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       layout: <layout>           : Arrangement of the packed pixel data,\n");
+    LOG_PRINT("                                  : applied after bpp packing and before\n");
+    LOG_PRINT("                                  : compression. Custom blitters can then\n");
+    LOG_PRINT("                                  : copy it without reshuffling.\n");
+    LOG_PRINT("                                  : Options are:\n");
+    LOG_PRINT("                                  :  \'row-major\': Rows top to bottom.\n");
+    LOG_PRINT("                                  :  \'column-major\': Columns left to right,\n");
+    LOG_PRINT("                                  :    each stored top to bottom. A column\n");
+    LOG_PRINT("                                  :    is one pixel wide, or one byte of\n");
+    LOG_PRINT("                                  :    packed pixels below 8 bpp.\n");
+    LOG_PRINT("                                  :  \'padded:<n>\': Rows padded with zeros to\n");
+    LOG_PRINT("                                  :    <n> bytes each.\n");
+    LOG_PRINT("                                  : Other layouts output \'_stride\', the\n");
+    LOG_PRINT("                                  : bytes per column or row, and\n");
+    LOG_PRINT("                                  : column-major also outputs\n");
+    LOG_PRINT("                                  : \'_column_major\'. Tilesets output\n");
+    LOG_PRINT("                                  : \'_tile_stride\'. Not available for rlet,\n");
+    LOG_PRINT("                                  : auto or compiled styles, or with\n");
+    LOG_PRINT("                                  : preshift. Default is \'row-major\'.\n");
+    LOG_PRINT("\n");
+    LOG_PRINT("       animation: <mode>          : Treats the images as frames in order.\n");
+    LOG_PRINT("                                  : Options are:\n");
+    LOG_PRINT("                                  :  \'none\': Images are independent.\n");
+    LOG_PRINT("                                  :  \'delta\': The first frame is stored in\n");
+    LOG_PRINT("                                  :    full and each later frame as the\n");
+    LOG_PRINT("                                  :    spans that changed from the frame\n");
+    LOG_PRINT("                                  :    before it. A span is a length byte,\n");
+    LOG_PRINT("                                  :    a 24-bit offset into the frame\'s\n");
+    LOG_PRINT("                                  :    pixels, then the indices; a zero\n");
+    LOG_PRINT("                                  :    length ends the frame. Frames are\n");
+    LOG_PRINT("                                  :    compressed individually and output\n");
+    LOG_PRINT("                                  :    as a tileset named after the convert\n");
+    LOG_PRINT("                                  :    with a frame table, marked \'_delta\'.\n");
+    LOG_PRINT("                                  :    Frames must share dimensions, and\n");
+    LOG_PRINT("                                  :    the convert must use the palette\n");
+    LOG_PRINT("                                  :    style at 8 bpp, without trim,\n");
+    LOG_PRINT("                                  :    preshift, masks, variants, scales,\n");
+    LOG_PRINT("                                  :    rotations or layout.\n");
+    LOG_PRINT("                                  : Default is \'none\'.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       omit-indices: [<list>]     : Omits the specified palette indices\n");
     LOG_PRINT("                                  : from the converted image. May be useful\n");
     LOG_PRINT("                                  : by a custom drawing routine. A comma\n");
@@ -361,6 +581,15 @@ static void options_show(const char *prgm)
     LOG_PRINT("                                  : to access image and palette data.\n");
     LOG_PRINT("                                  : Optional parameter.\n");
     LOG_PRINT("\n");
+    LOG_PRINT("       budget: <bytes>            : Chooses the style, bpp and compression of\n");
+    LOG_PRINT("                                  : each image in the AppVar\'s palette style\n");
+    LOG_PRINT("                                  : converts so the AppVar data fits within\n");
+    LOG_PRINT("                                  : <bytes>, at the lowest estimated decode\n");
+    LOG_PRINT("                                  : time. The choices are reported and\n");
+    LOG_PRINT("                                  : exported as \'_bpp\' and \'_compress\'\n");
+    LOG_PRINT("                                  : defines. Cannot be used with \'compress\'.\n");
+    LOG_PRINT("                                  : Optional parameter.\n");
+    LOG_PRINT("\n");
     LOG_PRINT("       header-string: <string>    : Prepends <string> to the start of the\n");
     LOG_PRINT("                                  : AppVar's data.\n");
     LOG_PRINT("                                  : Use double quotes to properly interpret\n");
@@ -472,6 +701,10 @@ static void options_set_default(struct options *options)
     options->prgm = NULL;
     options->convert_icon = false;
     options->clean = false;
+    options->profile_path = NULL;
+    options->mem_stats = false;
+    options->max_memory = 0;
+    options->stats = STATS_NONE;
     options->yaml_path = yaml_path;
 }
 
@@ -520,6 +753,7 @@ int options_get(int argc, char *argv[], struct options *options)
     for (;;)
     {
         int optidx = 0;
+        char *end;
         static struct option long_options[] =
         {
             {"icon",             required_argument, 0, 0},
@@ -533,9 +767,13 @@ int options_get(int argc, char *argv[], struct options *options)
             {"input",            required_argument, 0, 'i'},
             {"log-level",        required_argument, 0, 'l'},
             {"log-color",        required_argument, 0, 'x'},
+            {"profile",          required_argument, 0, 'p'},
+            {"mem-stats",        no_argument,       0, 'm'},
+            {"max-memory",       required_argument, 0, 'M'},
+            {"stats",            required_argument, 0, 's'},
             {0, 0, 0, 0}
         };
-        int c = getopt_long(argc, argv, "cnhvi:l:x:", long_options, &optidx);
+        int c = getopt_long(argc, argv, "cnhvi:l:x:p:mM:s:", long_options, &optidx);
 
         if (c == -1)
         {
@@ -616,6 +854,54 @@ int options_get(int argc, char *argv[], struct options *options)
                 log_set_color(strtoul(optarg, NULL, 0) ? true : false);
                 break;
 
+            case 'p':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                options->profile_path = optarg;
+                break;
+
+            case 'm':
+                options->mem_stats = true;
+                break;
+
+            case 'M':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                /* a unit suffix would otherwise be silently read as MiB */
+                options->max_memory = strtoul(optarg, &end, 0);
+                if (end == optarg || *end != '\0' ||
+                    options->max_memory == 0 || options->max_memory > SIZE_MAX / (1024 * 1024))
+                {
+                    LOG_ERROR("Invalid --max-memory '%s'.\n", optarg);
+                    return OPTIONS_FAILED;
+                }
+                options->max_memory *= 1024 * 1024;
+                break;
+
+            case 's':
+                if (optarg == NULL)
+                {
+                    break;
+                }
+                if (!strcmp(optarg, "text"))
+                {
+                    options->stats = STATS_TEXT;
+                }
+                else if (!strcmp(optarg, "json"))
+                {
+                    options->stats = STATS_JSON;
+                }
+                else
+                {
+                    LOG_ERROR("Invalid --stats format '%s'.\n", optarg);
+                    return OPTIONS_FAILED;
+                }
+                break;
+
             case 'h':
                 options_show(options->prgm);
                 return OPTIONS_IGNORE;
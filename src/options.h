@@ -33,6 +33,7 @@
 
 #include "parser.h"
 #include "icon.h"
+#include "stats.h"
 
 #include <stdbool.h>
 
@@ -53,6 +54,10 @@ struct options
     const char *yaml_path;
     bool convert_icon;
     bool clean;
+    const char *profile_path;
+    bool mem_stats;
+    size_t max_memory;
+    stats_format_t stats;
     struct icon icon;
 };
 
@@ -30,6 +30,7 @@
 
 #include "output.h"
 #include "appvar.h"
+#include "image.h"
 #include "strings.h"
 #include "memory.h"
 #include "log.h"
@@ -162,7 +163,7 @@ int output_appvar_init(struct output *output)
         {
             appvar_insert_entry(appvar, index, offset);
 
-            offset += output->palettes[i]->nr_entries * 2;
+            offset += output->palettes[i]->nr_entries * 2 + palette_tables_size(output->palettes[i]);
 
             index++;
         }
@@ -175,7 +176,7 @@ int output_appvar_init(struct output *output)
             {
                 appvar_insert_entry(appvar, index, offset);
 
-                offset += convert->images[j].data_size;
+                offset += convert->images[j].data_size + convert->images[j].mask_size;
 
                 index++;
             }
@@ -228,7 +229,7 @@ int output_appvar_init(struct output *output)
             {
                 appvar_insert_entry(appvar, index, offset);
 
-                offset += convert->images[j].data_size;
+                offset += convert->images[j].data_size + convert->images[j].mask_size;
 
                 index++;
             }
@@ -275,7 +276,7 @@ int output_appvar_init(struct output *output)
         {
             appvar_insert_entry(appvar, index, offset);
 
-            offset += output->palettes[i]->nr_entries * 2;
+            offset += output->palettes[i]->nr_entries * 2 + palette_tables_size(output->palettes[i]);
 
             index++;
         }
@@ -298,6 +299,18 @@ int output_appvar_image(struct output *output, const struct image *image)
     memcpy(&appvar->data[appvar->size], image->data, image->data_size);
     appvar->size += image->data_size;
 
+    /* the collision mask directly follows the image */
+    if (image->mask != NULL)
+    {
+        if (validate_data_size(appvar, image->mask_size) != 0)
+        {
+            return -1;
+        }
+
+        memcpy(&appvar->data[appvar->size], image->mask, image->mask_size);
+        appvar->size += image->mask_size;
+    }
+
     return 0;
 }
 
@@ -355,6 +368,29 @@ int output_appvar_palette(struct output *output, const struct palette *palette)
         appvar->size++;
     }
 
+    /* fade and remap tables directly follow the base palette */
+    if (palette->nr_fades)
+    {
+        if (validate_data_size(appvar, palette->fades_size) != 0)
+        {
+            return -1;
+        }
+
+        memcpy(&appvar->data[appvar->size], palette->fades, palette->fades_size);
+        appvar->size += palette->fades_size;
+    }
+
+    for (uint32_t i = 0; i < palette->nr_remaps; ++i)
+    {
+        if (validate_data_size(appvar, PALETTE_REMAP_SIZE) != 0)
+        {
+            return -1;
+        }
+
+        memcpy(&appvar->data[appvar->size], palette->remaps[i].table, PALETTE_REMAP_SIZE);
+        appvar->size += PALETTE_REMAP_SIZE;
+    }
+
     return 0;
 }
 
@@ -372,6 +408,26 @@ static void output_appvar_c_include_file_palettes(struct output *output, FILE *f
             palette->name,
             output->appvar.name,
             *index);
+        if (palette->nr_fades)
+        {
+            fprintf(fdh, "#define %s_nr_fades %u\n",
+                palette->name,
+                palette->nr_fades);
+            fprintf(fdh, "#define %s_fade(n) (%s + %u + ((n) * sizeof_%s))\n",
+                palette->name,
+                palette->name,
+                size + (output->palette_sizes ? 2 : 0),
+                palette->name);
+        }
+
+        for (uint32_t j = 0; j < palette->nr_remaps; ++j)
+        {
+            fprintf(fdh, "#define %s (%s + %u)\n",
+                palette->remaps[j].name,
+                palette->name,
+                size + (output->palette_sizes ? 2 : 0) +
+                    palette->fades_size + (j * PALETTE_REMAP_SIZE));
+        }
 
         *index = *index + 1;
     }
@@ -397,6 +453,77 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                 image->name,
                 image->height);
 
+            if (image->trimmed)
+            {
+                fprintf(fdh, "#define %s_x_offset %u\n",
+                    image->name,
+                    image->trim_x);
+                fprintf(fdh, "#define %s_y_offset %u\n",
+                    image->name,
+                    image->trim_y);
+                fprintf(fdh, "#define %s_orig_width %u\n",
+                    image->name,
+                    image->orig_width);
+                fprintf(fdh, "#define %s_orig_height %u\n",
+                    image->name,
+                    image->orig_height);
+            }
+
+            if (image->auto_bpp)
+            {
+                fprintf(fdh, "#define %s_bpp %u\n",
+                    image->name,
+                    image_bpp_bits(image->bpp));
+
+                if (image->nr_sub_palette_entries)
+                {
+                    fprintf(fdh, "extern unsigned char %s_sub_palette[%u];\n",
+                        image->name,
+                        image->nr_sub_palette_entries);
+                }
+            }
+
+            if (image->nr_shifts)
+            {
+                fprintf(fdh, "#define %s_nr_shifts %u\n",
+                    image->name,
+                    image->nr_shifts);
+                fprintf(fdh, "#define %s_shift_width %u\n",
+                    image->name,
+                    image->shift_width);
+                fprintf(fdh, "#define %s_shift_size %u\n",
+                    image->name,
+                    image->shift_size);
+
+                if (!image->compressed)
+                {
+                    fprintf(fdh, "#define %s_shift(n) (%s_appvar[%u] + (n) * %u)\n",
+                        image->name,
+                        output->appvar.name,
+                        *index,
+                        image->shift_size);
+                }
+            }
+
+            if (image->layout != IMAGE_LAYOUT_ROW_MAJOR)
+            {
+                if (image->layout == IMAGE_LAYOUT_COLUMN_MAJOR)
+                {
+                    fprintf(fdh, "#define %s_column_major 1\n",
+                        image->name);
+                }
+                fprintf(fdh, "#define %s_stride %u\n",
+                    image->name,
+                    image->stride);
+            }
+
+            if (image->auto_encoded)
+            {
+                fprintf(fdh, "#define %s_compress %u\n",
+                    image->name,
+                    (unsigned int)image->compress);
+            }
+
             if (image->compressed)
             {
                 fprintf(fdh, "#define %s_%s_%s_compressed_index %u\n",
@@ -426,6 +553,26 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                         output->appvar.name,
                         *index);
                 }
+                else if (image->compiled)
+                {
+                    fprintf(fdh, "#define %s ((void (*)(void *))%s_appvar[%u])\n",
+                        image->name,
+                        output->appvar.name,
+                        *index);
+                }
+            }
+
+            if (image->mask != NULL)
+            {
+                fprintf(fdh, "#define %s_mask_stride %u\n",
+                    image->name,
+                    image->mask_stride);
+                fprintf(fdh, "#define %s_mask%s (%s_appvar[%u] + %u)\n",
+                    image->name,
+                    image->mask_compressed ? "_compressed" : "",
+                    output->appvar.name,
+                    *index,
+                    image->data_size);
             }
 
             *index = *index + 1;
@@ -444,6 +591,13 @@ static void output_appvar_c_include_file_converts(struct output *output, FILE *f
                 tileset->image.name,
                 tileset->tile_height);
 
+            if (tileset->image.auto_bpp)
+            {
+                fprintf(fdh, "#define %s_bpp %u\n",
+                    tileset->image.name,
+                    image_bpp_bits(tileset->image.bpp));
+            }
+
             if (tileset->compressed)
             {
                 fprintf(fdh, "#define %s_compressed %s_appvar[%u]\n",
@@ -599,7 +753,7 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
             fprintf(fds, "    (unsigned char*)%u,\n",
                 offset);
 
-            offset += palette->nr_entries * 2;
+            offset += palette->nr_entries * 2 + palette_tables_size(palette);
         }
 
         for (uint32_t i = 0; i < output->nr_converts; ++i)
@@ -611,7 +765,7 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
                 fprintf(fds, "    (unsigned char*)%u,\n",
                     offset);
 
-                offset += convert->images[j].data_size;
+                offset += convert->images[j].data_size + convert->images[j].mask_size;
             }
 
             for (uint32_t k = 0; k < convert->nr_tilesets; ++k)
@@ -693,6 +847,34 @@ void output_appvar_c_source_file(struct output *output, FILE *fds)
         }
     }
 
+    for (uint32_t i = 0; i < output->nr_converts; ++i)
+    {
+        const struct convert *convert = output->converts[i];
+
+        for (uint32_t j = 0; j < convert->nr_images; ++j)
+        {
+            const struct image *image = &convert->images[j];
+
+            if (image->nr_sub_palette_entries == 0)
+            {
+                continue;
+            }
+
+            fprintf(fds, "unsigned char %s_sub_palette[%u] =\n{\n   ",
+                image->name,
+                image->nr_sub_palette_entries);
+
+            for (uint32_t k = 0; k < image->nr_sub_palette_entries; ++k)
+            {
+                fprintf(fds, " 0x%02x%s",
+                    image->sub_palette[k],
+                    k + 1 == image->nr_sub_palette_entries ? "" : ",");
+            }
+
+            fprintf(fds, "\n};\n\n");
+        }
+    }
+
     if (appvar->init)
     {
         bool has_tilesets = false;
@@ -923,9 +1105,31 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                     palette->name,
                     offset);
 
+                if (palette->nr_fades)
+                {
+                    fprintf(fdh, "%s_%s_nr_fades := %u\n",
+                        output->appvar.name,
+                        palette->name,
+                        palette->nr_fades);
+
+                    fprintf(fdh, "%s_%s_fades_offset := %u\n",
+                        output->appvar.name,
+                        palette->name,
+                        offset + size + (output->palette_sizes ? 2 : 0));
+                }
+
+                for (uint32_t j = 0; j < palette->nr_remaps; ++j)
+                {
+                    fprintf(fdh, "%s_%s_offset := %u\n",
+                        output->appvar.name,
+                        palette->remaps[j].name,
+                        offset + size + (output->palette_sizes ? 2 : 0) +
+                            palette->fades_size + (j * PALETTE_REMAP_SIZE));
+                }
+
                 nr_entries++;
 
-                offset += size;
+                offset += size + palette_tables_size(palette);
             }
         }
         else
@@ -954,6 +1158,93 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                         image->name,
                         image->height);
 
+                    if (image->trimmed)
+                    {
+                        fprintf(fdh, "%s_%s_%s_x_offset := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->trim_x);
+                        fprintf(fdh, "%s_%s_%s_y_offset := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->trim_y);
+                        fprintf(fdh, "%s_%s_%s_orig_width := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->orig_width);
+                        fprintf(fdh, "%s_%s_%s_orig_height := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->orig_height);
+                    }
+
+                    if (image->auto_bpp)
+                    {
+                        fprintf(fdh, "%s_%s_%s_bpp := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image_bpp_bits(image->bpp));
+
+                        for (uint32_t k = 0; k < image->nr_sub_palette_entries; ++k)
+                        {
+                            fprintf(fdh, "%s_%s_%s_sub_palette_%u := %u\n",
+                                output->appvar.name,
+                                convert->name,
+                                image->name,
+                                k,
+                                image->sub_palette[k]);
+                        }
+                    }
+
+                    if (image->nr_shifts)
+                    {
+                        fprintf(fdh, "%s_%s_%s_nr_shifts := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->nr_shifts);
+                        fprintf(fdh, "%s_%s_%s_shift_width := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->shift_width);
+                        fprintf(fdh, "%s_%s_%s_shift_size := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->shift_size);
+                    }
+
+                    if (image->layout != IMAGE_LAYOUT_ROW_MAJOR)
+                    {
+                        if (image->layout == IMAGE_LAYOUT_COLUMN_MAJOR)
+                        {
+                            fprintf(fdh, "%s_%s_%s_column_major := 1\n",
+                                output->appvar.name,
+                                convert->name,
+                                image->name);
+                        }
+                        fprintf(fdh, "%s_%s_%s_stride := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->stride);
+                    }
+
+                    if (image->auto_encoded)
+                    {
+                        fprintf(fdh, "%s_%s_%s_compress := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            (unsigned int)image->compress);
+                    }
+
                     if (image->compressed)
                     {
                         fprintf(fdh, "%s_%s_%s_compressed_offset := %u\n",
@@ -971,9 +1262,24 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                             offset);
                     }
 
+                    if (image->mask != NULL)
+                    {
+                        fprintf(fdh, "%s_%s_%s_mask_stride := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->mask_stride);
+                        fprintf(fdh, "%s_%s_%s_mask%s_offset := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            image->name,
+                            image->mask_compressed ? "_compressed" : "",
+                            offset + image->data_size);
+                    }
+
                     nr_entries++;
 
-                    offset += convert->images[j].data_size;
+                    offset += convert->images[j].data_size + convert->images[j].mask_size;
                 }
 
                 for (uint32_t k = 0; k < convert->nr_tilesets; ++k)
@@ -998,6 +1304,15 @@ void output_appvar_asm_include_file(struct output *output, FILE *fdh)
                         convert->name,
                         tileset->image.name,
                         tileset->nr_tiles);
+
+                    if (tileset->image.auto_bpp)
+                    {
+                        fprintf(fdh, "%s_%s_%s_bpp := %u\n",
+                            output->appvar.name,
+                            convert->name,
+                            tileset->image.name,
+                            image_bpp_bits(tileset->image.bpp));
+                    }
                     fprintf(fdh, "%s_%s_%s_tiles%soffset := %u\n",
                         output->appvar.name,
                         convert->name,
@@ -1139,13 +1454,13 @@ int output_appvar_include(struct output *output)
         goto error;
     }
 
-    free(var_name);
-    free(var_c_name);
+    memory_free(var_name);
+    memory_free(var_c_name);
 
     return 0;
 
 error:
-    free(var_name);
-    free(var_c_name);
+    memory_free(var_name);
+    memory_free(var_c_name);
     return -1;
 }
@@ -32,13 +32,14 @@
 #include "tileset.h"
 #include "strings.h"
 #include "image.h"
+#include "memory.h"
 #include "log.h"
 #include "clean.h"
 
 #include <errno.h>
 #include <string.h>
 
-static int output_asm_array(unsigned char *arr, uint32_t size, FILE *fdo)
+static int output_asm_array(const unsigned char *arr, uint32_t size, FILE *fdo)
 {
     uint32_t i;
 
@@ -88,6 +89,31 @@ int output_asm_image(struct output *output, const struct image *image)
     fprintf(fds, "%s_width := %u\n", image->name, image->width);
     fprintf(fds, "%s_height := %u\n", image->name, image->height);
     fprintf(fds, "%s_size := %u\n", image->name, image->uncompressed_size);
+    if (image->trimmed)
+    {
+        fprintf(fds, "%s_x_offset := %u\n", image->name, image->trim_x);
+        fprintf(fds, "%s_y_offset := %u\n", image->name, image->trim_y);
+        fprintf(fds, "%s_orig_width := %u\n", image->name, image->orig_width);
+        fprintf(fds, "%s_orig_height := %u\n", image->name, image->orig_height);
+    }
+    if (image->auto_bpp)
+    {
+        fprintf(fds, "%s_bpp := %u\n", image->name, image_bpp_bits(image->bpp));
+    }
+    if (image->nr_shifts)
+    {
+        fprintf(fds, "%s_nr_shifts := %u\n", image->name, image->nr_shifts);
+        fprintf(fds, "%s_shift_width := %u\n", image->name, image->shift_width);
+        fprintf(fds, "%s_shift_size := %u\n", image->name, image->shift_size);
+    }
+    if (image->layout != IMAGE_LAYOUT_ROW_MAJOR)
+    {
+        if (image->layout == IMAGE_LAYOUT_COLUMN_MAJOR)
+        {
+            fprintf(fds, "%s_column_major := 1\n", image->name);
+        }
+        fprintf(fds, "%s_stride := %u\n", image->name, image->stride);
+    }
     if (image->compressed)
     {
         fprintf(fds, "%s_compressed_size := %u\n", image->name, image->data_size);
@@ -96,14 +122,30 @@ int output_asm_image(struct output *output, const struct image *image)
 
     output_asm_array(image->data, image->data_size, fds);
 
+    if (image->nr_sub_palette_entries)
+    {
+        fprintf(fds, "%s_sub_palette:\n\tdb\t", image->name);
+
+        output_asm_array(image->sub_palette, image->nr_sub_palette_entries, fds);
+    }
+
+    if (image->mask != NULL)
+    {
+        fprintf(fds, "%s_mask_stride := %u\n", image->name, image->mask_stride);
+        fprintf(fds, "%s_mask%s:\n\tdb\t", image->name,
+            image->mask_compressed ? "_compressed" : "");
+
+        output_asm_array(image->mask, image->mask_size, fds);
+    }
+
     fclose(fds);
 
-    free(source);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(source);
+    memory_free(source);
     return -1;
 }
 
@@ -131,6 +173,43 @@ int output_asm_tileset(struct output *output, const struct tileset *tileset)
         tileset->image.name,
         tileset->nr_tiles);
 
+    if (tileset->delta)
+    {
+        fprintf(fds, "%s_delta := 1\n", tileset->image.name);
+    }
+
+    if (tileset->image.auto_bpp)
+    {
+        fprintf(fds, "%s_bpp := %u\n",
+            tileset->image.name,
+            image_bpp_bits(tileset->image.bpp));
+    }
+
+    if (tileset->nr_banks)
+    {
+        fprintf(fds, "%s_nr_banks := %u\n",
+            tileset->image.name,
+            tileset->nr_banks);
+        fprintf(fds, "%s_banks:\n\tdb\t", tileset->image.name);
+
+        output_asm_array(tileset->banks, tileset->nr_banks * TILESET_BANK_SIZE, fds);
+
+        fprintf(fds, "%s_tile_banks:\n\tdb\t", tileset->image.name);
+
+        output_asm_array(tileset->tile_banks, tileset->nr_tiles, fds);
+    }
+
+    if (tileset->image.layout != IMAGE_LAYOUT_ROW_MAJOR)
+    {
+        if (tileset->image.layout == IMAGE_LAYOUT_COLUMN_MAJOR)
+        {
+            fprintf(fds, "%s_column_major := 1\n", tileset->image.name);
+        }
+        fprintf(fds, "%s_tile_stride := %u\n",
+            tileset->image.name,
+            tileset->image.stride);
+    }
+
     for (uint32_t i = 0; i < tileset->nr_tiles; ++i)
     {
         struct tileset_tile *tile = &tileset->tiles[i];
@@ -153,12 +232,12 @@ int output_asm_tileset(struct output *output, const struct tileset *tileset)
     }
 
     fclose(fds);
-    free(source);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(source);
+    memory_free(source);
     return -1;
 }
 
@@ -215,14 +294,32 @@ int output_asm_palette(struct output *output, const struct palette *palette)
         }
     }
 
+    if (palette->nr_fades)
+    {
+        fprintf(fds, "%s_nr_fades := %u\n", palette->name, palette->nr_fades);
+        fprintf(fds, "sizeof_%s_fades := %u\n", palette->name, palette->fades_size);
+        fprintf(fds, "%s_fades:\n\tdb\t", palette->name);
+
+        output_asm_array(palette->fades, palette->fades_size, fds);
+    }
+
+    for (uint32_t i = 0; i < palette->nr_remaps; ++i)
+    {
+        const struct palette_remap *remap = &palette->remaps[i];
+
+        fprintf(fds, "%s:\n\tdb\t", remap->name);
+
+        output_asm_array(remap->table, PALETTE_REMAP_SIZE, fds);
+    }
+
     fclose(fds);
 
-    free(source);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(source);
+    memory_free(source);
     return -1;
 }
 
@@ -279,12 +376,12 @@ int output_asm_include(struct output *output)
 
     fclose(fd);
 
-    free(include_name);
+    memory_free(include_name);
 
     return 0;
 
 error:
-    free(include_name);
+    memory_free(include_name);
     return -1;
 }
 
@@ -113,6 +113,32 @@ int output_basic_palette(struct output *output, const struct palette *palette)
 
     fprintf(fd, "\"\n\n");
 
+    if (palette->nr_fades)
+    {
+        fprintf(fd, "%s_fades | %u bytes\n\"", palette->name, palette->fades_size);
+
+        for (i = 0; i < palette->fades_size; ++i)
+        {
+            fprintf(fd, "%02X", palette->fades[i]);
+        }
+
+        fprintf(fd, "\"\n\n");
+    }
+
+    for (i = 0; i < palette->nr_remaps; ++i)
+    {
+        const struct palette_remap *remap = &palette->remaps[i];
+
+        fprintf(fd, "%s | %u bytes\n\"", remap->name, PALETTE_REMAP_SIZE);
+
+        for (uint32_t j = 0; j < PALETTE_REMAP_SIZE; ++j)
+        {
+            fprintf(fd, "%02X", remap->table[j]);
+        }
+
+        fprintf(fd, "\"\n\n");
+    }
+
     fclose(fd);
 
     return 0;
@@ -32,6 +32,7 @@
 #include "tileset.h"
 #include "strings.h"
 #include "image.h"
+#include "memory.h"
 #include "log.h"
 #include "clean.h"
 
@@ -70,12 +71,12 @@ int output_bin_image(struct output *output, const struct image *image)
 
     fclose(fds);
 
-    free(source);
+    memory_free(source);
 
     return ret;
 
 error:
-    free(source);
+    memory_free(source);
     return -1;
 }
 
@@ -127,12 +128,12 @@ int output_bin_tileset(struct output *output, const struct tileset *tileset)
 
     fclose(fds);
 
-    free(source);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(source);
+    memory_free(source);
     return -1;
 }
 
@@ -173,14 +174,25 @@ int output_bin_palette(struct output *output, const struct palette *palette)
         fputc((target >> 8) & 255, fds);
     }
 
+    /* fade and remap tables directly follow the base palette */
+    if (palette->nr_fades)
+    {
+        fwrite(palette->fades, palette->fades_size, 1, fds);
+    }
+
+    for (i = 0; i < palette->nr_remaps; ++i)
+    {
+        fwrite(palette->remaps[i].table, PALETTE_REMAP_SIZE, 1, fds);
+    }
+
     fclose(fds);
 
-    free(source);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(source);
+    memory_free(source);
     return -1;
 }
 
@@ -242,12 +254,12 @@ int output_bin_include(struct output *output)
 
     fclose(fdi);
 
-    free(include_name);
+    memory_free(include_name);
 
     return 0;
 
 error:
-    free(include_name);
+    memory_free(include_name);
     return -1;
 }
 
@@ -31,13 +31,14 @@
 #include "tileset.h"
 #include "strings.h"
 #include "image.h"
+#include "memory.h"
 #include "log.h"
 #include "clean.h"
 
 #include <errno.h>
 #include <string.h>
 
-static int output_c_array(unsigned char *arr, uint32_t size, FILE *fdo)
+static int output_c_array(const unsigned char *arr, uint32_t size, FILE *fdo)
 {
     for (uint32_t i = 0; i < size; ++i)
     {
@@ -100,6 +101,45 @@ int output_c_image(struct output *output, const struct image *image)
     fprintf(fdh, "#define %s_height %u\n", image->name, image->height);
     fprintf(fdh, "#define %s_size %u\n", image->name, image->uncompressed_size);
 
+    if (image->trimmed)
+    {
+        fprintf(fdh, "#define %s_x_offset %u\n", image->name, image->trim_x);
+        fprintf(fdh, "#define %s_y_offset %u\n", image->name, image->trim_y);
+        fprintf(fdh, "#define %s_orig_width %u\n", image->name, image->orig_width);
+        fprintf(fdh, "#define %s_orig_height %u\n", image->name, image->orig_height);
+    }
+
+    if (image->auto_bpp)
+    {
+        fprintf(fdh, "#define %s_bpp %u\n", image->name, image_bpp_bits(image->bpp));
+        if (image->nr_sub_palette_entries)
+        {
+            fprintf(fdh, "extern %sunsigned char %s_sub_palette[%u];\n",
+                output->constant, image->name, image->nr_sub_palette_entries);
+        }
+    }
+
+    if (image->nr_shifts)
+    {
+        fprintf(fdh, "#define %s_nr_shifts %u\n", image->name, image->nr_shifts);
+        fprintf(fdh, "#define %s_shift_width %u\n", image->name, image->shift_width);
+        fprintf(fdh, "#define %s_shift_size %u\n", image->name, image->shift_size);
+        if (!image->compressed)
+        {
+            fprintf(fdh, "#define %s_shift(n) (&%s_data[(n) * %u])\n",
+                image->name, image->name, image->shift_size);
+        }
+    }
+
+    if (image->layout != IMAGE_LAYOUT_ROW_MAJOR)
+    {
+        if (image->layout == IMAGE_LAYOUT_COLUMN_MAJOR)
+        {
+            fprintf(fdh, "#define %s_column_major 1\n", image->name);
+        }
+        fprintf(fdh, "#define %s_stride %u\n", image->name, image->stride);
+    }
+
     if (image->compressed)
     {
         fprintf(fdh, "#define %s_compressed_size %u\n", image->name, image->data_size);
@@ -116,11 +156,26 @@ int output_c_image(struct output *output, const struct image *image)
                 image->rlet ? "gfx_rletsprite_t" : "gfx_sprite_t",
                 image->name);
         }
+        else if (image->compiled)
+        {
+            fprintf(fdh, "#define %s ((void (*)(void *))%s_data)\n",
+                image->name,
+                image->name);
+        }
 
         fprintf(fdh, "extern %sunsigned char %s_data[%u];\n",
             output->constant, image->name, image->data_size);
     }
 
+    if (image->mask != NULL)
+    {
+        fprintf(fdh, "#define %s_mask_stride %u\n", image->name, image->mask_stride);
+        fprintf(fdh, "extern %sunsigned char %s_mask%s[%u];\n",
+            output->constant, image->name,
+            image->mask_compressed ? "_compressed" : "",
+            image->mask_size);
+    }
+
     fprintf(fdh, "\n");
     fprintf(fdh, "#ifdef __cplusplus\n");
     fprintf(fdh, "}\n");
@@ -152,16 +207,34 @@ int output_c_image(struct output *output, const struct image *image)
 
     output_c_array(image->data, image->data_size, fds);
 
+    if (image->nr_sub_palette_entries)
+    {
+        fprintf(fds, "%sunsigned char %s_sub_palette[%u] =\n{",
+            output->constant, image->name, image->nr_sub_palette_entries);
+
+        output_c_array(image->sub_palette, image->nr_sub_palette_entries, fds);
+    }
+
+    if (image->mask != NULL)
+    {
+        fprintf(fds, "%sunsigned char %s_mask%s[%u] =\n{",
+            output->constant, image->name,
+            image->mask_compressed ? "_compressed" : "",
+            image->mask_size);
+
+        output_c_array(image->mask, image->mask_size, fds);
+    }
+
     fclose(fds);
 
-    free(header);
-    free(source);
+    memory_free(header);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(header);
-    free(source);
+    memory_free(header);
+    memory_free(source);
     return -1;
 }
 
@@ -238,6 +311,44 @@ int output_c_tileset(struct output *output, const struct tileset *tileset)
         tileset->image.name,
         tileset->nr_tiles);
 
+    if (tileset->delta)
+    {
+        fprintf(fdh, "#define %s_delta 1\n", tileset->image.name);
+    }
+
+    if (tileset->image.auto_bpp)
+    {
+        fprintf(fdh, "#define %s_bpp %u\n",
+            tileset->image.name,
+            image_bpp_bits(tileset->image.bpp));
+    }
+
+    if (tileset->nr_banks)
+    {
+        fprintf(fdh, "#define %s_nr_banks %u\n",
+            tileset->image.name,
+            tileset->nr_banks);
+        fprintf(fdh, "extern %sunsigned char %s_banks[%u];\n",
+            output->constant,
+            tileset->image.name,
+            tileset->nr_banks * TILESET_BANK_SIZE);
+        fprintf(fdh, "extern %sunsigned char %s_tile_banks[%u];\n",
+            output->constant,
+            tileset->image.name,
+            tileset->nr_tiles);
+    }
+
+    if (tileset->image.layout != IMAGE_LAYOUT_ROW_MAJOR)
+    {
+        if (tileset->image.layout == IMAGE_LAYOUT_COLUMN_MAJOR)
+        {
+            fprintf(fdh, "#define %s_column_major 1\n", tileset->image.name);
+        }
+        fprintf(fdh, "#define %s_tile_stride %u\n",
+            tileset->image.name,
+            tileset->image.stride);
+    }
+
     if (tileset->p_table)
     {
         if (tileset->compressed)
@@ -307,6 +418,23 @@ int output_c_tileset(struct output *output, const struct tileset *tileset)
         output_c_array(tile->data, tile->data_size, fds);
     }
 
+    if (tileset->nr_banks)
+    {
+        fprintf(fds, "%sunsigned char %s_banks[%u] =\n{",
+            output->constant,
+            tileset->image.name,
+            tileset->nr_banks * TILESET_BANK_SIZE);
+
+        output_c_array(tileset->banks, tileset->nr_banks * TILESET_BANK_SIZE, fds);
+
+        fprintf(fds, "%sunsigned char %s_tile_banks[%u] =\n{",
+            output->constant,
+            tileset->image.name,
+            tileset->nr_tiles);
+
+        output_c_array(tileset->tile_banks, tileset->nr_tiles, fds);
+    }
+
     if (tileset->p_table)
     {
         if (tileset->compressed)
@@ -345,14 +473,14 @@ int output_c_tileset(struct output *output, const struct tileset *tileset)
 
     fclose(fds);
 
-    free(header);
-    free(source);
+    memory_free(header);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(header);
-    free(source);
+    memory_free(header);
+    memory_free(source);
     return -1;
 }
 
@@ -397,6 +525,20 @@ int output_c_palette(struct output *output, const struct palette *palette)
     fprintf(fdh, "#define sizeof_%s %u\n", palette->name, size);
     fprintf(fdh, "extern %sunsigned char %s[%u];\n",
         output->constant, palette->name, size);
+    if (palette->nr_fades)
+    {
+        fprintf(fdh, "#define %s_nr_fades %u\n", palette->name, palette->nr_fades);
+        fprintf(fdh, "#define sizeof_%s_fades %u\n", palette->name, palette->fades_size);
+        fprintf(fdh, "extern %sunsigned char %s_fades[%u];\n",
+            output->constant, palette->name, palette->fades_size);
+        fprintf(fdh, "#define %s_fade(n) (%s_fades + ((n) * sizeof_%s))\n",
+            palette->name, palette->name, palette->name);
+    }
+    for (uint32_t i = 0; i < palette->nr_remaps; ++i)
+    {
+        fprintf(fdh, "extern %sunsigned char %s[%u];\n",
+            output->constant, palette->remaps[i].name, PALETTE_REMAP_SIZE);
+    }
     fprintf(fdh, "\n");
     fprintf(fdh, "#ifdef __cplusplus\n");
     fprintf(fdh, "}\n");
@@ -450,16 +592,34 @@ int output_c_palette(struct output *output, const struct palette *palette)
     }
     fprintf(fds, "};\n");
 
+    if (palette->nr_fades)
+    {
+        fprintf(fds, "\n%sunsigned char %s_fades[%u] =\n{",
+            output->constant, palette->name, palette->fades_size);
+
+        output_c_array(palette->fades, palette->fades_size, fds);
+    }
+
+    for (uint32_t i = 0; i < palette->nr_remaps; ++i)
+    {
+        const struct palette_remap *remap = &palette->remaps[i];
+
+        fprintf(fds, "\n%sunsigned char %s[%u] =\n{",
+            output->constant, remap->name, PALETTE_REMAP_SIZE);
+
+        output_c_array(remap->table, PALETTE_REMAP_SIZE, fds);
+    }
+
     fclose(fds);
 
-    free(header);
-    free(source);
+    memory_free(header);
+    memory_free(source);
 
     return 0;
 
 error:
-    free(header);
-    free(source);
+    memory_free(header);
+    memory_free(source);
     return -1;
 }
 
@@ -534,12 +694,12 @@ int output_c_include(struct output *output)
 
     fclose(fdi);
 
-    free(include_name);
+    memory_free(include_name);
 
     return 0;
 
 error:
-    free(include_name);
+    memory_free(include_name);
     return -1;
 }
 
@@ -29,9 +29,11 @@
  */
 
 #include "output.h"
+#include "budget.h"
 #include "strings.h"
 #include "memory.h"
 #include "clean.h"
+#include "profile.h"
 #include "log.h"
 
 #include <errno.h>
@@ -83,10 +85,12 @@ struct output *output_alloc(void)
     output->include_file = NULL;
     output->convert_names = NULL;
     output->nr_converts = 0;
+    output->nr_convert_names_alloc = 0;
     output->converts = NULL;
     output->palette_names = NULL;
     output->palettes = NULL;
     output->nr_palettes = 0;
+    output->nr_palette_names_alloc = 0;
     output->palette_sizes = false;
     output->order = OUTPUT_PALETTES_FIRST;
     output->format = OUTPUT_FORMAT_INVALID;
@@ -96,6 +100,7 @@ struct output *output_alloc(void)
     output->appvar.init = true;
     output->appvar.source = APPVAR_SOURCE_NONE;
     output->appvar.compress = COMPRESS_NONE;
+    output->appvar.budget = 0;
     output->appvar.size = 0;
     output->appvar.lut = false;
     output->appvar.header = NULL;
@@ -109,23 +114,17 @@ struct output *output_alloc(void)
         goto error;
     }
 
-    output->appvar.data = memory_alloc(APPVAR_MAX_BEFORE_COMPRESSION_SIZE);
-    if (output->appvar.data == NULL)
-    {
-        goto error;
-    }
-
     return output;
 
 error:
-    free(output);
+    memory_free(output);
     output = NULL;
     return NULL;
 }
 
 int output_add_convert_name(struct output *output, const char *name)
 {
-    output->convert_names = memory_realloc_array(output->convert_names, output->nr_converts + 1, sizeof(char *));
+    output->convert_names = memory_grow_array(output->convert_names, &output->nr_convert_names_alloc, output->nr_converts, sizeof(char *));
     if (output->convert_names == NULL)
     {
         return -1;
@@ -146,7 +145,7 @@ int output_add_convert_name(struct output *output, const char *name)
 
 int output_add_palette_name(struct output *output, const char *name)
 {
-    output->palette_names = memory_realloc_array(output->palette_names, output->nr_palettes + 1, sizeof(char *));
+    output->palette_names = memory_grow_array(output->palette_names, &output->nr_palette_names_alloc, output->nr_palettes, sizeof(char *));
     if (output->palette_names == NULL)
     {
         return -1;
@@ -174,43 +173,45 @@ void output_free(struct output *output)
 
     for (uint32_t i = 0; i < output->nr_converts; ++i)
     {
-        free(output->convert_names[i]);
+        memory_free(output->convert_names[i]);
         output->convert_names[i] = NULL;
     }
     output->nr_converts = 0;
 
     for (uint32_t i = 0; i < output->nr_palettes; ++i)
     {
-        free(output->palette_names[i]);
+        memory_free(output->palette_names[i]);
         output->palette_names[i] = NULL;
     }
     output->nr_palettes = 0;
 
-    free(output->convert_names);
+    memory_free(output->convert_names);
     output->convert_names = NULL;
+    output->nr_convert_names_alloc = 0;
 
-    free(output->palette_names);
+    memory_free(output->palette_names);
     output->palette_names = NULL;
+    output->nr_palette_names_alloc = 0;
 
-    free(output->appvar.name);
+    memory_free(output->appvar.name);
     output->appvar.name = NULL;
 
-    free(output->appvar.header);
+    memory_free(output->appvar.header);
     output->appvar.header = NULL;
 
-    free(output->appvar.data);
+    memory_free(output->appvar.data);
     output->appvar.data = NULL;
 
-    free(output->converts);
+    memory_free(output->converts);
     output->converts = NULL;
 
-    free(output->palettes);
+    memory_free(output->palettes);
     output->palettes = NULL;
 
-    free(output->include_file);
+    memory_free(output->include_file);
     output->include_file = NULL;
 
-    free(output->directory);
+    memory_free(output->directory);
     output->directory = NULL;
 }
 
@@ -245,9 +246,11 @@ static int output_init(struct output *output)
     return -1;
 }
 
-static int output_find_converts(struct output *output, struct convert **converts, uint32_t nr_converts)
+static int output_find_converts(struct output *output,
+    struct convert **converts,
+    const struct registry *convert_registry)
 {
-    if (converts == NULL || nr_converts == 0)
+    if (converts == NULL || convert_registry->nr_names == 0)
     {
         return 0;
     }
@@ -260,29 +263,26 @@ static int output_find_converts(struct output *output, struct convert **converts
 
     for (uint32_t i = 0; i < output->nr_converts; ++i)
     {
-        for (uint32_t j = 0; j < nr_converts; ++j)
+        uint32_t index;
+
+        if (registry_find(convert_registry, output->convert_names[i], &index))
         {
-            if (strcmp(output->convert_names[i], converts[j]->name) == 0)
-            {
-                output->converts[i] = converts[j];
-                goto nextconvert;
-            }
+            LOG_ERROR("No matching convert name \'%s\' found for output.\n",
+                     output->convert_names[i]);
+            return -1;
         }
 
-        LOG_ERROR("No matching convert name \'%s\' found for output.\n",
-                 output->convert_names[i]);
-        return -1;
-
-nextconvert:
-        continue;
+        output->converts[i] = converts[index];
     }
 
     return 0;
 }
 
-static int output_find_palettes(struct output *output, struct palette **palettes, uint32_t nr_palettes)
+static int output_find_palettes(struct output *output,
+    struct palette **palettes,
+    const struct registry *palette_registry)
 {
-    if (palettes == NULL || nr_palettes == 0)
+    if (palettes == NULL || palette_registry->nr_names == 0)
     {
         goto nopalette;
     }
@@ -295,13 +295,12 @@ static int output_find_palettes(struct output *output, struct palette **palettes
 
     for (uint32_t i = 0; i < output->nr_palettes; ++i)
     {
-        for (uint32_t j = 0; j < nr_palettes; ++j)
+        uint32_t index;
+
+        if (!registry_find(palette_registry, output->palette_names[i], &index))
         {
-            if (strcmp(output->palette_names[i], palettes[j]->name) == 0)
-            {
-                output->palettes[i] = palettes[j];
-                goto nextpalette;
-            }
+            output->palettes[i] = palettes[index];
+            goto nextpalette;
         }
 
 nopalette:
@@ -429,8 +428,12 @@ static int output_converts(struct output *output)
         for (uint32_t j = 0; j < convert->nr_images; ++j)
         {
             const struct image *image = &convert->images[j];
+            int ret;
 
-            if (output_image(output, image))
+            profile_begin("write", image->name);
+            ret = output_image(output, image);
+            profile_end("write", image->name);
+            if (ret)
             {
                 return -1;
             }
@@ -439,8 +442,12 @@ static int output_converts(struct output *output)
         for (uint32_t j = 0; j < convert->nr_tilesets; ++j)
         {
             const struct tileset *tileset = &convert->tilesets[j];
+            int ret;
 
-            if (output_tileset(output, tileset))
+            profile_begin("write", tileset->image.name);
+            ret = output_tileset(output, tileset);
+            profile_end("write", tileset->image.name);
+            if (ret)
             {
                 return -1;
             }
@@ -455,11 +462,15 @@ static int output_palettes(struct output *output)
     for (uint32_t i = 0; i < output->nr_palettes; ++i)
     {
         const struct palette *palette = output->palettes[i];
+        int ret;
 
         LOG_INFO("Generating output for palette \'%s\'\n",
             palette->name);
 
-        if (output_palette(output, palette))
+        profile_begin("write", palette->name);
+        ret = output_palette(output, palette);
+        profile_end("write", palette->name);
+        if (ret)
         {
             return -1;
         }
@@ -470,20 +481,38 @@ static int output_palettes(struct output *output)
 
 int output_generate(struct output *output,
                     struct palette **palettes,
-                    uint32_t nr_palettes,
+                    const struct registry *palette_registry,
                     struct convert **converts,
-                    uint32_t nr_converts)
+                    const struct registry *convert_registry)
 {
-    if (output_find_palettes(output, palettes, nr_palettes))
+    if (output_find_palettes(output, palettes, palette_registry))
     {
         return -1;
     }
 
-    if (output_find_converts(output, converts, nr_converts))
+    if (output_find_converts(output, converts, convert_registry))
     {
         return -1;
     }
 
+    if (output->format == OUTPUT_FORMAT_APPVAR && output->appvar.budget != 0)
+    {
+        if (budget_solve(output))
+        {
+            return -1;
+        }
+    }
+
+    /* only held while the appvar is built, so outputs do not add up */
+    if (output->format == OUTPUT_FORMAT_APPVAR)
+    {
+        output->appvar.data = memory_alloc(APPVAR_MAX_BEFORE_COMPRESSION_SIZE);
+        if (output->appvar.data == NULL)
+        {
+            return -1;
+        }
+    }
+
     if (output_init(output))
     {
         return -1;
@@ -519,5 +548,8 @@ int output_generate(struct output *output,
         return -1;
     }
 
+    memory_free(output->appvar.data);
+    output->appvar.data = NULL;
+
     return 0;
 }
@@ -35,6 +35,7 @@
 #include "convert.h"
 #include "palette.h"
 #include "compress.h"
+#include "registry.h"
 
 #include <stdint.h>
 
@@ -65,9 +66,11 @@ struct output
     char **convert_names;
     struct convert **converts;
     uint32_t nr_converts;
+    uint32_t nr_convert_names_alloc;
     char **palette_names;
     struct palette **palettes;
     uint32_t nr_palettes;
+    uint32_t nr_palette_names_alloc;
     output_format_t format;
     const char *constant;
     bool palette_sizes;
@@ -88,9 +91,9 @@ int output_add_palette_name(struct output *output,
 
 int output_generate(struct output *output,
     struct palette **palettes,
-    uint32_t nr_palettes,
+    const struct registry *palette_registry,
     struct convert **converts,
-    uint32_t nr_converts);
+    const struct registry *convert_registry);
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,8 @@
 #include "memory.h"
 #include "strings.h"
 #include "image.h"
+#include "profile.h"
+#include "stats.h"
 #include "log.h"
 
 #include "deps/libimagequant/libimagequant.h"
@@ -42,6 +44,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <glob.h>
+#include <math.h>
 
 /* maximum number of colors that can be quantized */
 #define MAX_NR_COLORS 536870912
@@ -63,6 +66,7 @@ struct palette *palette_alloc(void)
 
     palette->images = NULL;
     palette->nr_images = 0;
+    palette->nr_images_alloc = 0;
     palette->max_entries = PALETTE_MAX_ENTRIES;
     palette->nr_entries = 0;
     palette->nr_fixed_entries = 0;
@@ -70,6 +74,12 @@ struct palette *palette_alloc(void)
     palette->quantize_speed = PALETTE_DEFAULT_QUANTIZE_SPEED;
     palette->automatic = false;
     palette->name = NULL;
+    palette->nr_fades = 0;
+    palette->fade_color.rgba = 0;
+    palette->fades = NULL;
+    palette->fades_size = 0;
+    palette->remaps = NULL;
+    palette->nr_remaps = 0;
 
     for (i = 0; i < PALETTE_MAX_ENTRIES; ++i)
     {
@@ -92,7 +102,7 @@ static int palette_add_image(struct palette *palette, const char *path)
         return -1;
     }
 
-    palette->images = memory_realloc_array(palette->images, palette->nr_images + 1, sizeof(struct image));
+    palette->images = memory_grow_array(palette->images, &palette->nr_images_alloc, palette->nr_images, sizeof(struct image));
     if (palette->images == NULL)
     {
         return -1;
@@ -146,7 +156,7 @@ int pallete_add_path(struct palette *palette, const char *path)
     {
         LOG_ERROR("Could not find file(s): \'%s\'\n", real_path);
         globfree(&globbuf);
-        free(real_path);
+        memory_free(real_path);
         return -1;
     }
 
@@ -156,7 +166,7 @@ int pallete_add_path(struct palette *palette, const char *path)
     }
 
     globfree(&globbuf);
-    free(real_path);
+    memory_free(real_path);
 
     return 0;
 }
@@ -172,20 +182,33 @@ void palette_free(struct palette *palette)
     {
         struct image *image = &palette->images[i];
 
-        free(image->name);
+        memory_free(image->name);
         image->name = NULL;
 
-        free(image->path);
+        memory_free(image->path);
         image->path = NULL;
 
-        free(image->data);
+        memory_free(image->data);
         image->path = NULL;
     }
 
-    free(palette->images);
+    memory_free(palette->images);
     palette->images = NULL;
+    palette->nr_images_alloc = 0;
 
-    free(palette->name);
+    memory_free(palette->fades);
+    palette->fades = NULL;
+
+    for (uint32_t i = 0; i < palette->nr_remaps; ++i)
+    {
+        memory_free(palette->remaps[i].name);
+        memory_free(palette->remaps[i].palette_name);
+    }
+
+    memory_free(palette->remaps);
+    palette->remaps = NULL;
+
+    memory_free(palette->name);
     palette->name = NULL;
 }
 
@@ -329,7 +352,7 @@ int palette_generate_with_images(struct palette *palette)
     uint32_t nr_max_entries;
     uint32_t nr_unused_entries;
     
-    attr = liq_attr_create();
+    attr = liq_attr_create_with_allocator(memory_alloc, memory_free);
 
     liq_set_speed(attr, palette->quantize_speed);
 
@@ -398,12 +421,14 @@ int palette_generate_with_images(struct palette *palette)
         {
             liq_histogram_destroy(hist);
             liq_attr_destroy(attr);
-            free(colors);
+            memory_free(colors);
             return -1;
         }
 
         const uint32_t *image_rgba = (uint32_t*)image->data;
 
+        stats_source_colors(image_rgba, image->width * image->height);
+
         for (uint32_t j = 0; j < image->width * image->height; ++j)
         {
             struct color color;
@@ -424,7 +449,7 @@ int palette_generate_with_images(struct palette *palette)
             if (nr_colors == MAX_NR_COLORS)
             {
                 LOG_ERROR("Too many colors to quantize\n");
-                free(colors);
+                memory_free(colors);
                 return -1;
             }
 
@@ -449,6 +474,9 @@ int palette_generate_with_images(struct palette *palette)
 
             nr_colors++;
         }
+
+        memory_free(image->data);
+        image->data = NULL;
     }
 
     LOG_DEBUG("%u colors in palette before quantization\n", nr_colors);
@@ -457,6 +485,7 @@ int palette_generate_with_images(struct palette *palette)
     {
         liq_result *liqresult = NULL;
         liq_image *liqimage;
+        memory_tag_t tag;
 
         liqimage = liq_image_create_rgba(attr, colors, 1, nr_colors, 0);
         if (liqimage == NULL)
@@ -464,7 +493,7 @@ int palette_generate_with_images(struct palette *palette)
             LOG_ERROR("Failed to create palette - image may be too large\n");
             liq_histogram_destroy(hist);
             liq_attr_destroy(attr);
-            free(colors);
+            memory_free(colors);
             return -1;
         }
 
@@ -475,14 +504,18 @@ int palette_generate_with_images(struct palette *palette)
             liq_histogram_destroy(hist);
             liq_image_destroy(liqimage);
             liq_attr_destroy(attr);
-            free(colors);
+            memory_free(colors);
             return -1;
         }
 
         liq_image_destroy(liqimage);
-        free(colors);
+        memory_free(colors);
 
+        profile_begin("quantize", palette->name);
+        tag = memory_set_tag(MEMORY_TAG_QUANTIZE);
         liqerr = liq_histogram_quantize(hist, attr, &liqresult);
+        memory_set_tag(tag);
+        profile_end("quantize", palette->name);
         if (liqerr != LIQ_OK)
         {
             LOG_ERROR("Failed to quantize palette.\n");
@@ -491,6 +524,8 @@ int palette_generate_with_images(struct palette *palette)
             return -1;
         }
 
+        stats_quantize();
+
         liqpalette = liq_get_palette(liqresult);
 
         /* store the quantized palette */
@@ -639,8 +674,235 @@ int palette_generate_with_images(struct palette *palette)
     return 0;
 }
 
+static int palette_color_to_target(const struct palette *palette, const struct color *color, uint16_t *target)
+{
+    switch (palette->color_fmt)
+    {
+        case COLOR_1555_GRGB:
+            *target = color_to_1555_grgb(color);
+            break;
+
+        case COLOR_565_BGR:
+            *target = color_to_565_bgr(color);
+            break;
+
+        case COLOR_565_RGB:
+            *target = color_to_565_rgb(color);
+            break;
+
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+static bool palette_is_builtin(const struct palette *palette)
+{
+    return !strcmp(palette->name, "xlibc") || !strcmp(palette->name, "rgb332");
+}
+
+/* weighted toward green, which the eye is most sensitive to */
+uint32_t palette_color_distance(const struct color *a, const struct color *b)
+{
+    int32_t dr = (int32_t)a->r - b->r;
+    int32_t dg = (int32_t)a->g - b->g;
+    int32_t db = (int32_t)a->b - b->b;
+
+    return (2 * dr * dr) + (4 * dg * dg) + (3 * db * db);
+}
+
+uint32_t palette_nearest_index(const struct palette *palette, const struct color *color)
+{
+    uint32_t best = UINT32_MAX;
+    uint32_t index = 0;
+
+    for (uint32_t i = 0; i < palette->nr_entries; ++i)
+    {
+        const struct palette_entry *entry = &palette->entries[i];
+        uint32_t dist;
+
+        if (!entry->valid)
+        {
+            continue;
+        }
+
+        dist = palette_color_distance(&entry->color, color);
+        if (dist < best)
+        {
+            best = dist;
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+/* bytes of fade and remap tables stored directly after the palette */
+uint32_t palette_tables_size(const struct palette *palette)
+{
+    return palette->fades_size + (palette->nr_remaps * PALETTE_REMAP_SIZE);
+}
+
+static void palette_remap_color(const struct palette_remap *remap, struct color *color)
+{
+    uint8_t gray;
+
+    switch (remap->transform)
+    {
+        case PALETTE_REMAP_GRAYSCALE:
+            gray = round((0.299 * color->r) + (0.587 * color->g) + (0.114 * color->b));
+            color->r = gray;
+            color->g = gray;
+            color->b = gray;
+            break;
+
+        case PALETTE_REMAP_INVERT:
+            color->r = 255 - color->r;
+            color->g = 255 - color->g;
+            color->b = 255 - color->b;
+            break;
+
+        case PALETTE_REMAP_TINT:
+            color->r = round(color->r + ((remap->color.r - color->r) * remap->amount / 100.0));
+            color->g = round(color->g + ((remap->color.g - color->g) * remap->amount / 100.0));
+            color->b = round(color->b + ((remap->color.b - color->b) * remap->amount / 100.0));
+            break;
+
+        default:
+            break;
+    }
+}
+
+int palette_generate_remaps(struct palette *palette, struct palette **palettes, uint32_t nr_palettes)
+{
+    for (uint32_t i = 0; i < palette->nr_remaps; ++i)
+    {
+        struct palette_remap *remap = &palette->remaps[i];
+        const struct palette *target = palette;
+
+        if (remap->palette_name != NULL)
+        {
+            target = NULL;
+
+            for (uint32_t j = 0; j < nr_palettes; ++j)
+            {
+                if (!strcmp(remap->palette_name, palettes[j]->name))
+                {
+                    target = palettes[j];
+                    break;
+                }
+            }
+
+            if (target == NULL)
+            {
+                LOG_ERROR("No palette \'%s\' found for remap \'%s\'\n",
+                    remap->palette_name,
+                    remap->name);
+                return -1;
+            }
+
+            if (palette_is_builtin(target))
+            {
+                LOG_ERROR("Remap \'%s\' cannot target built-in palette \'%s\'.\n",
+                    remap->name,
+                    target->name);
+                return -1;
+            }
+        }
+
+        for (uint32_t j = 0; j < PALETTE_REMAP_SIZE; ++j)
+        {
+            const struct palette_entry *entry = &palette->entries[j];
+            struct color color;
+
+            /* unused and kept entries map to themselves */
+            if (j >= palette->nr_entries || !entry->valid || remap->keep[j])
+            {
+                remap->table[j] = j;
+                continue;
+            }
+
+            color = entry->color;
+            palette_remap_color(remap, &color);
+
+            remap->table[j] = palette_nearest_index(target, &color);
+        }
+
+        LOG_INFO(" - Generated remap \'%s\' for palette \'%s\'\n",
+            remap->name, palette->name);
+    }
+
+    return 0;
+}
+
+/* fade n of N blends every entry (n + 1) / N of the way to the fade color */
+static int palette_generate_fades(struct palette *palette)
+{
+    const struct color *to = &palette->fade_color;
+    uint32_t size = palette->nr_entries * sizeof(uint16_t);
+    uint8_t *dst;
+
+    if (palette->nr_fades == 0)
+    {
+        return 0;
+    }
+
+    palette->fades_size = palette->nr_fades * size;
+    palette->fades = memory_alloc(palette->fades_size);
+    if (palette->fades == NULL)
+    {
+        return -1;
+    }
+
+    dst = palette->fades;
+
+    for (uint32_t n = 0; n < palette->nr_fades; ++n)
+    {
+        double t = (double)(n + 1) / palette->nr_fades;
+
+        for (uint32_t i = 0; i < palette->nr_entries; ++i)
+        {
+            const struct palette_entry *entry = &palette->entries[i];
+            const struct color *from = &entry->color;
+            uint16_t target = 0;
+
+            if (entry->valid)
+            {
+                struct color color;
+
+                color.r = round(from->r + ((to->r - from->r) * t));
+                color.g = round(from->g + ((to->g - from->g) * t));
+                color.b = round(from->b + ((to->b - from->b) * t));
+                color.a = 255;
+
+                if (palette_color_to_target(palette, &color, &target))
+                {
+                    return -1;
+                }
+            }
+
+            *dst++ = target & 255;
+            *dst++ = (target >> 8) & 255;
+        }
+    }
+
+    LOG_INFO(" - Generated %u fades for palette \'%s\'\n",
+        palette->nr_fades, palette->name);
+
+    return 0;
+}
+
 int palette_generate(struct palette *palette, struct convert **converts, uint32_t nr_converts)
 {
+    if ((palette->nr_fades != 0 || palette->nr_remaps != 0) &&
+        palette_is_builtin(palette))
+    {
+        LOG_ERROR("Built-in palette \'%s\' does not support \'fades\' or \'remaps\'.\n",
+            palette->name);
+        return -1;
+    }
+
     if (!strcmp(palette->name, "xlibc"))
     {
         palette_generate_builtin(palette,
@@ -723,27 +985,14 @@ int palette_generate(struct palette *palette, struct convert **converts, uint32_
         /* convert the entries into the target format */
         if (entry->valid)
         {
-            switch (palette->color_fmt)
+            if (palette_color_to_target(palette, &entry->color, &entry->target))
             {
-                case COLOR_1555_GRGB:
-                    entry->target = color_to_1555_grgb(&entry->color);
-                    break;
-
-                case COLOR_565_BGR:
-                    entry->target = color_to_565_bgr(&entry->color);
-                    break;
-
-                case COLOR_565_RGB:
-                    entry->target = color_to_565_rgb(&entry->color);
-                    break;
-
-                default:
-                    return -1;
+                return -1;
             }
         }
     }
 
-    return 0;
+    return palette_generate_fades(palette);
 }
 
 static uint8_t palette_xlibc[] =
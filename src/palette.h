@@ -46,6 +46,9 @@ extern "C" {
 
 #define PALETTE_MAX_ENTRIES 256
 #define PALETTE_DEFAULT_QUANTIZE_SPEED 3
+#define PALETTE_MAX_FADES 64
+#define PALETTE_MAX_REMAPS 16
+#define PALETTE_REMAP_SIZE 256
 
 struct convert;
 
@@ -60,11 +63,31 @@ struct palette_entry
     bool fixed;
 };
 
+typedef enum
+{
+    PALETTE_REMAP_NONE,
+    PALETTE_REMAP_GRAYSCALE,
+    PALETTE_REMAP_INVERT,
+    PALETTE_REMAP_TINT,
+} palette_remap_transform_t;
+
+struct palette_remap
+{
+    char *name;
+    char *palette_name;
+    palette_remap_transform_t transform;
+    struct color color;
+    uint32_t amount;
+    bool keep[PALETTE_MAX_ENTRIES];
+    uint8_t table[PALETTE_REMAP_SIZE];
+};
+
 struct palette
 {
     char *name;
     struct image *images;
     uint32_t nr_images;
+    uint32_t nr_images_alloc;
     uint32_t max_entries;
     uint32_t nr_entries;
     uint32_t nr_fixed_entries;
@@ -73,6 +96,16 @@ struct palette
     struct palette_entry fixed_entries[PALETTE_MAX_ENTRIES];
     color_format_t color_fmt;
     bool automatic;
+
+    /* set when fades are requested */
+    uint32_t nr_fades;
+    struct color fade_color;
+    uint8_t *fades;
+    uint32_t fades_size;
+
+    /* set when remaps are requested */
+    struct palette_remap *remaps;
+    uint32_t nr_remaps;
 };
 
 struct palette *palette_alloc(void);
@@ -86,6 +119,18 @@ int palette_generate(struct palette *palette,
     struct convert **converts,
     uint32_t nr_converts);
 
+int palette_generate_remaps(struct palette *palette,
+    struct palette **palettes,
+    uint32_t nr_palettes);
+
+uint32_t palette_color_distance(const struct color *a,
+    const struct color *b);
+
+uint32_t palette_nearest_index(const struct palette *palette,
+    const struct color *color);
+
+uint32_t palette_tables_size(const struct palette *palette);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,7 @@
 
 #include "parser.h"
 #include "strings.h"
+#include "dircache.h"
 #include "memory.h"
 #include "log.h"
 
@@ -79,7 +80,7 @@ static struct palette *parser_alloc_palette(struct yaml *yaml, void *name)
 
     LOG_DEBUG("Allocating palette: %s\n", (char*)name);
 
-    yaml->palettes = memory_realloc_array(yaml->palettes, yaml->nr_palettes + 1, sizeof(struct palette *));
+    yaml->palettes = memory_grow_array(yaml->palettes, &yaml->nr_palettes_alloc, yaml->nr_palettes, sizeof(struct palette *));
     if (yaml->palettes == NULL)
     {
         return NULL;
@@ -124,7 +125,7 @@ static struct convert *parser_alloc_convert(struct yaml *yaml, void *name)
 
     LOG_DEBUG("Allocating convert: %s\n", (char*)name);
 
-    yaml->converts = memory_realloc_array(yaml->converts, yaml->nr_converts + 1, sizeof(struct convert *));
+    yaml->converts = memory_grow_array(yaml->converts, &yaml->nr_converts_alloc, yaml->nr_converts, sizeof(struct convert *));
     if (yaml->converts == NULL)
     {
         return NULL;
@@ -155,7 +156,7 @@ static struct output *parser_alloc_output(struct yaml *yaml, void *type)
 
     LOG_DEBUG("Allocating output: %s\n", (char*)type);
 
-    yaml->outputs = memory_realloc_array(yaml->outputs, yaml->nr_outputs + 1, sizeof(struct output *));
+    yaml->outputs = memory_grow_array(yaml->outputs, &yaml->nr_outputs_alloc, yaml->nr_outputs, sizeof(struct output *));
     if (yaml->outputs == NULL)
     {
         return NULL;
@@ -226,6 +227,11 @@ static int parser_init(struct yaml *yaml)
     yaml->nr_palettes = 0;
     yaml->nr_converts = 0;
     yaml->nr_outputs = 0;
+    yaml->nr_palettes_alloc = 0;
+    yaml->nr_converts_alloc = 0;
+    yaml->nr_outputs_alloc = 0;
+    registry_init(&yaml->palette_registry);
+    registry_init(&yaml->convert_registry);
 
     if (parser_alloc_palette(yaml, "xlibc") == NULL)
     {
@@ -561,6 +567,233 @@ static int parse_palette_images(struct palette *palette, yaml_document_t *doc, y
     return 0;
 }
 
+/* a color is 'black', 'white', a hex string, or a fixed entry style mapping */
+static int parse_color(struct color *color, yaml_document_t *doc, yaml_node_t *root)
+{
+    char *value;
+
+    if (root->type == YAML_MAPPING_NODE)
+    {
+        struct palette_entry entry;
+
+        if (parse_palette_entry(&entry, doc, root))
+        {
+            return -1;
+        }
+
+        *color = entry.color;
+        return 0;
+    }
+
+    value = (char *)root->data.scalar.value;
+
+    if (parse_str_cmp("black", value))
+    {
+        color->r = 0;
+        color->g = 0;
+        color->b = 0;
+    }
+    else if (parse_str_cmp("white", value))
+    {
+        color->r = 255;
+        color->g = 255;
+        color->b = 255;
+    }
+    else if (!strings_hex_color(value, color))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_palette_remap_keeps(struct palette_remap *remap, yaml_document_t *doc, yaml_node_t *root)
+{
+    yaml_node_item_t *item = root->data.sequence.items.start;
+    for (; item < root->data.sequence.items.top; ++item)
+    {
+        yaml_node_t *node = yaml_document_get_node(doc, *item);
+        if (node != NULL)
+        {
+            long index = strtol((char *)node->data.scalar.value, NULL, 0);
+
+            if (index > 255 || index < 0)
+            {
+                LOG_ERROR("Invalid keep index value %ld\n", index);
+                parser_show_mark_error(node->start_mark);
+                return -1;
+            }
+
+            remap->keep[index] = true;
+        }
+    }
+
+    return 0;
+}
+
+static int parse_palette_remap(struct palette *palette, yaml_document_t *doc, yaml_node_t *root)
+{
+    struct palette_remap *remap;
+    yaml_node_pair_t *pair;
+
+    if (palette->nr_remaps >= PALETTE_MAX_REMAPS)
+    {
+        LOG_ERROR("Too many remaps for palette \'%s\'.\n", palette->name);
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    palette->remaps = memory_realloc_array(palette->remaps, palette->nr_remaps + 1, sizeof(struct palette_remap));
+    if (palette->remaps == NULL)
+    {
+        return -1;
+    }
+
+    remap = &palette->remaps[palette->nr_remaps];
+    memset(remap, 0, sizeof(struct palette_remap));
+    remap->transform = PALETTE_REMAP_NONE;
+    remap->amount = 100;
+    palette->nr_remaps++;
+
+    pair = root->data.mapping.pairs.start;
+    for (; pair < root->data.mapping.pairs.top; ++pair)
+    {
+        yaml_node_t *keyn = yaml_document_get_node(doc, pair->key);
+        yaml_node_t *valuen = yaml_document_get_node(doc, pair->value);
+        char *key;
+        char *value;
+
+        if (keyn == NULL || valuen == NULL)
+        {
+            continue;
+        }
+
+        key = (char*)keyn->data.scalar.value;
+        value = (char*)valuen->data.scalar.value;
+
+        if (parse_str_cmp("name", key))
+        {
+            memory_free(remap->name);
+            remap->name = strings_dup(value);
+            if (remap->name == NULL)
+            {
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("palette", key))
+        {
+            memory_free(remap->palette_name);
+            remap->palette_name = strings_dup(value);
+            if (remap->palette_name == NULL)
+            {
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("transform", key))
+        {
+            if (parse_str_cmp("none", value))
+            {
+                remap->transform = PALETTE_REMAP_NONE;
+            }
+            else if (parse_str_cmp("grayscale", value))
+            {
+                remap->transform = PALETTE_REMAP_GRAYSCALE;
+            }
+            else if (parse_str_cmp("invert", value))
+            {
+                remap->transform = PALETTE_REMAP_INVERT;
+            }
+            else if (parse_str_cmp("tint", value))
+            {
+                remap->transform = PALETTE_REMAP_TINT;
+            }
+            else
+            {
+                LOG_ERROR("Invalid remap \'transform\' parameter.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("color", key))
+        {
+            if (parse_color(&remap->color, doc, valuen))
+            {
+                LOG_ERROR("Invalid remap \'color\' parameter.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("amount", key))
+        {
+            int tmpi = strtol(value, NULL, 0);
+            if (tmpi > 100 || tmpi < 0)
+            {
+                LOG_ERROR("Invalid remap \'amount\' parameter.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            remap->amount = tmpi;
+        }
+        else if (parse_str_cmp("keep-indices", key))
+        {
+            if (parse_palette_remap_keeps(remap, doc, valuen))
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            LOG_ERROR("Unknown remap option: %s\n", key);
+            parser_show_mark_error(keyn->start_mark);
+            return -1;
+        }
+    }
+
+    if (remap->name == NULL)
+    {
+        LOG_ERROR("Missing remap \'name\' parameter.\n");
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    if (remap->palette_name == NULL && remap->transform == PALETTE_REMAP_NONE)
+    {
+        LOG_ERROR("Remap \'%s\' needs a \'palette\' or a \'transform\'.\n", remap->name);
+        parser_show_mark_error(root->start_mark);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_palette_remaps(struct palette *palette, yaml_document_t *doc, yaml_node_t *root)
+{
+    yaml_node_item_t *item = root->data.sequence.items.start;
+    for (; item < root->data.sequence.items.top; ++item)
+    {
+        yaml_node_t *node = yaml_document_get_node(doc, *item);
+
+        if (node == NULL)
+        {
+            continue;
+        }
+
+        if (node->type != YAML_MAPPING_NODE)
+        {
+            LOG_ERROR("Invalid remap formatting.\n");
+            parser_show_mark_error(node->start_mark);
+            return -1;
+        }
+
+        if (parse_palette_remap(palette, doc, node))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int parse_palette(struct yaml *data, yaml_document_t *doc, yaml_node_t *root)
 {
     struct palette *palette = NULL;
@@ -656,6 +889,33 @@ static int parse_palette(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
                 }
                 palette->quantize_speed = 11 - tmpi;
             }
+            else if (parse_str_cmp("fades", key))
+            {
+                tmpi = strtol(value, NULL, 0);
+                if (tmpi > PALETTE_MAX_FADES || tmpi < 1)
+                {
+                    LOG_ERROR("Invalid palette \'fades\' parameter.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+                palette->nr_fades = tmpi;
+            }
+            else if (parse_str_cmp("fade-color", key))
+            {
+                if (parse_color(&palette->fade_color, doc, valuen))
+                {
+                    LOG_ERROR("Invalid palette \'fade-color\' parameter.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+            }
+            else if (parse_str_cmp("remaps", key))
+            {
+                if (parse_palette_remaps(palette, doc, valuen))
+                {
+                    return -1;
+                }
+            }
             else if (parse_str_cmp("fixed-entries", key))
             {
                 if (parse_palette_fixed_entries(palette, doc, valuen))
@@ -707,6 +967,126 @@ static int parse_convert_omits(struct convert *convert, yaml_document_t *doc, ya
     return 0;
 }
 
+static int parse_convert_variants(struct convert *convert, yaml_document_t *doc, yaml_node_t *root)
+{
+    yaml_node_item_t *item = root->data.sequence.items.start;
+    for (; item < root->data.sequence.items.top; ++item)
+    {
+        yaml_node_t *node = yaml_document_get_node(doc, *item);
+        image_transform_t transform;
+        char *value;
+
+        if (node == NULL)
+        {
+            continue;
+        }
+
+        value = (char *)node->data.scalar.value;
+
+        if (parse_str_cmp("none", value))
+        {
+            transform = IMAGE_TRANSFORM_NONE;
+        }
+        else if (parse_str_cmp("flip-x", value))
+        {
+            transform = IMAGE_TRANSFORM_FLIP_X;
+        }
+        else if (parse_str_cmp("flip-y", value))
+        {
+            transform = IMAGE_TRANSFORM_FLIP_Y;
+        }
+        else if (parse_str_cmp("rot90", value))
+        {
+            transform = IMAGE_TRANSFORM_ROT_90;
+        }
+        else if (parse_str_cmp("rot180", value))
+        {
+            transform = IMAGE_TRANSFORM_ROT_180;
+        }
+        else if (parse_str_cmp("rot270", value))
+        {
+            transform = IMAGE_TRANSFORM_ROT_270;
+        }
+        else if (parse_str_cmp("transpose", value))
+        {
+            transform = IMAGE_TRANSFORM_TRANSPOSE;
+        }
+        else if (parse_str_cmp("transverse", value))
+        {
+            transform = IMAGE_TRANSFORM_TRANSVERSE;
+        }
+        else
+        {
+            LOG_ERROR("Invalid variant \'%s\'.\n", value);
+            parser_show_mark_error(node->start_mark);
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < convert->nr_variants; ++i)
+        {
+            if (convert->variants[i] == transform)
+            {
+                LOG_ERROR("Duplicate variant \'%s\'.\n", value);
+                parser_show_mark_error(node->start_mark);
+                return -1;
+            }
+        }
+
+        convert->variants[convert->nr_variants] = transform;
+        convert->nr_variants++;
+    }
+
+    return 0;
+}
+
+static int parse_convert_scales(struct convert *convert, yaml_document_t *doc, yaml_node_t *root)
+{
+    yaml_node_item_t *item = root->data.sequence.items.start;
+    for (; item < root->data.sequence.items.top; ++item)
+    {
+        yaml_node_t *node = yaml_document_get_node(doc, *item);
+        char *value;
+        float scale;
+
+        if (node == NULL)
+        {
+            continue;
+        }
+
+        value = (char *)node->data.scalar.value;
+        scale = strtof(value, NULL);
+
+        if (scale <= 0.0f || scale > CONVERT_MAX_SCALE)
+        {
+            LOG_ERROR("Invalid scale \'%s\'.\n", value);
+            parser_show_mark_error(node->start_mark);
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < convert->nr_scales; ++i)
+        {
+            if (convert->scales[i] == scale)
+            {
+                LOG_ERROR("Duplicate scale \'%s\'.\n", value);
+                parser_show_mark_error(node->start_mark);
+                return -1;
+            }
+        }
+
+        if (convert->nr_scales >= CONVERT_MAX_SCALES)
+        {
+            LOG_ERROR("Too many scales.\n");
+            parser_show_mark_error(node->start_mark);
+            return -1;
+        }
+
+        convert->scales[convert->nr_scales] = scale;
+        convert->nr_scales++;
+    }
+
+    return 0;
+}
+
 static int parse_convert_images(struct convert *convert, yaml_document_t *doc, yaml_node_t *root)
 {
     yaml_node_item_t *item;
@@ -955,7 +1335,7 @@ static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
         {
             if (convert->palette_name != NULL)
             {
-                free(convert->palette_name);
+                memory_free(convert->palette_name);
             }
             convert->palette_name = strings_dup(value);
             if (convert->palette_name == NULL)
@@ -981,13 +1361,49 @@ static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
             {
                 convert->style = CONVERT_STYLE_DIRECT;
             }
-            else
+            else if (parse_str_cmp("auto", value))
             {
-                LOG_ERROR("Invalid convert style.\n");
-                parser_show_mark_error(keyn->start_mark);
+                convert->style = CONVERT_STYLE_AUTO;
+            }
+            else if (parse_str_cmp("compiled", value))
+            {
+                convert->style = CONVERT_STYLE_COMPILED;
+            }
+            else
+            {
+                LOG_ERROR("Invalid convert style.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("style-objective", key))
+        {
+            if (parse_str_cmp("size", value))
+            {
+                convert->style_objective = CONVERT_OBJECTIVE_SIZE;
+            }
+            else if (parse_str_cmp("speed", value))
+            {
+                convert->style_objective = CONVERT_OBJECTIVE_SPEED;
+            }
+            else
+            {
+                LOG_ERROR("Invalid \'style-objective\' option.\n");
+                parser_show_mark_error(keyn->start_mark);
                 return -1;
             }
         }
+        else if (parse_str_cmp("decode-weight", key))
+        {
+            float tmpf = strtof(value, NULL);
+            if (tmpf < 0)
+            {
+                LOG_ERROR("Invalid decode weight.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            convert->decode_weight = tmpf;
+        }
         else if (parse_str_cmp("color-format", key))
         {
             if (parse_str_cmp("grgb1555", value))
@@ -1103,16 +1519,23 @@ static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
         }
         else if (parse_str_cmp("bpp", key))
         {
-            switch (strtol(value, NULL, 0))
+            if (parse_str_cmp("auto", value))
             {
-                case 8: convert->bpp = BPP_8; break;
-                case 4: convert->bpp = BPP_4; break;
-                case 2: convert->bpp = BPP_2; break;
-                case 1: convert->bpp = BPP_1; break;
-                default:
-                    LOG_ERROR("Invalid bpp option.\n");
-                    parser_show_mark_error(keyn->start_mark);
-                    return -1;
+                convert->bpp = BPP_AUTO;
+            }
+            else
+            {
+                switch (strtol(value, NULL, 0))
+                {
+                    case 8: convert->bpp = BPP_8; break;
+                    case 4: convert->bpp = BPP_4; break;
+                    case 2: convert->bpp = BPP_2; break;
+                    case 1: convert->bpp = BPP_1; break;
+                    default:
+                        LOG_ERROR("Invalid bpp option.\n");
+                        parser_show_mark_error(keyn->start_mark);
+                        return -1;
+                }
             }
         }
         else if (parse_str_cmp("flip-x", key))
@@ -1127,6 +1550,117 @@ static int parse_convert(struct yaml *data, yaml_document_t *doc, yaml_node_t *r
         {
             convert->add_width_height = parse_str_bool(value);
         }
+        else if (parse_str_cmp("trim", key))
+        {
+            convert->trim = parse_str_bool(value);
+        }
+        else if (parse_str_cmp("masks", key))
+        {
+            convert->masks = parse_str_bool(value);
+        }
+        else if (parse_str_cmp("preshift", key))
+        {
+            convert->preshift = parse_str_bool(value);
+        }
+        else if (parse_str_cmp("scales", key))
+        {
+            if (parse_convert_scales(convert, doc, valuen))
+            {
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("scale-filter", key))
+        {
+            if (parse_str_cmp("box", value))
+            {
+                convert->scale_filter = IMAGE_SCALE_BOX;
+            }
+            else if (parse_str_cmp("lanczos", value))
+            {
+                convert->scale_filter = IMAGE_SCALE_LANCZOS;
+            }
+            else
+            {
+                LOG_ERROR("Invalid scale filter.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("palette-banks", key))
+        {
+            tmpi = strtol(value, NULL, 0);
+            if (tmpi < 1 || tmpi > TILESET_MAX_BANKS)
+            {
+                LOG_ERROR("Invalid number of palette banks.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            convert->palette_banks = tmpi;
+        }
+        else if (parse_str_cmp("animation", key))
+        {
+            if (parse_str_cmp("none", value))
+            {
+                convert->animation = CONVERT_ANIMATION_NONE;
+            }
+            else if (parse_str_cmp("delta", value))
+            {
+                convert->animation = CONVERT_ANIMATION_DELTA;
+            }
+            else
+            {
+                LOG_ERROR("Invalid animation mode.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("layout", key))
+        {
+            if (parse_str_cmp("row-major", value))
+            {
+                convert->layout = IMAGE_LAYOUT_ROW_MAJOR;
+            }
+            else if (parse_str_cmp("column-major", value))
+            {
+                convert->layout = IMAGE_LAYOUT_COLUMN_MAJOR;
+            }
+            else if (strncmp(value, "padded:", strlen("padded:")) == 0)
+            {
+                tmpi = strtol(value + strlen("padded:"), NULL, 0);
+                if (tmpi < 1 || tmpi > 65535)
+                {
+                    LOG_ERROR("Invalid padded layout stride.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+                convert->layout = IMAGE_LAYOUT_PADDED;
+                convert->layout_stride = tmpi;
+            }
+            else
+            {
+                LOG_ERROR("Invalid layout.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+        }
+        else if (parse_str_cmp("rotations", key))
+        {
+            tmpi = strtol(value, NULL, 0);
+            if (tmpi > CONVERT_MAX_ROTATIONS || tmpi < 1)
+            {
+                LOG_ERROR("Invalid number of rotations.\n");
+                parser_show_mark_error(keyn->start_mark);
+                return -1;
+            }
+            convert->nr_rotations = tmpi;
+        }
+        else if (parse_str_cmp("variants", key))
+        {
+            if (parse_convert_variants(convert, doc, valuen))
+            {
+                return -1;
+            }
+        }
         else if (parse_str_cmp("omit-indices", key))
         {
             if (parse_convert_omits(convert, doc, valuen))
@@ -1244,7 +1778,7 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
         {
             if (output->include_file != NULL)
             {
-                free(output->include_file);
+                memory_free(output->include_file);
             }
             output->include_file = strings_dup(value);
             if (output->include_file == NULL)
@@ -1256,7 +1790,7 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
         {
             if (output->directory != NULL)
             {
-                free(output->directory);
+                memory_free(output->directory);
                 output->directory = NULL;
             }
             char *tmp = strings_dup(value);
@@ -1267,7 +1801,7 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
             if (*tmp && tmp[strlen(tmp) - 1] != '/')
             {
                 output->directory = strings_concat(tmp, "/", 0);
-                free(tmp);
+                memory_free(tmp);
             }
             else
             {
@@ -1314,7 +1848,7 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
             {
                 if (output->appvar.name != NULL)
                 {
-                    free(output->appvar.name);
+                    memory_free(output->appvar.name);
                 }
                 output->appvar.name = strings_dup(value);
                 if (output->appvar.name == NULL)
@@ -1387,6 +1921,17 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
                     return -1;
                 }
             }
+            else if (parse_str_cmp("budget", key))
+            {
+                int tmpi = strtol(value, NULL, 0);
+                if (tmpi <= 0 || tmpi > APPVAR_MAX_DATA_SIZE)
+                {
+                    LOG_ERROR("Invalid AppVar budget.\n");
+                    parser_show_mark_error(keyn->start_mark);
+                    return -1;
+                }
+                output->appvar.budget = tmpi;
+            }
             else if (parse_str_cmp("header-string", key))
             {
                 char *header;
@@ -1427,49 +1972,417 @@ static int parse_output(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *ro
     return 0;
 }
 
-static int parse_palettes(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *root)
+/* anchored nodes are copied here so aliases resolve in later entries */
+struct parser_anchor
 {
-    yaml_node_item_t *item = root->data.sequence.items.start;
-    for (; item < root->data.sequence.items.top && item != NULL; ++item)
+    char *name;
+    int id;
+};
+
+struct parser_anchors
+{
+    yaml_document_t doc;
+    struct parser_anchor *anchors;
+    uint32_t nr_anchors;
+    uint32_t nr_anchors_alloc;
+};
+
+static int parser_next_event(yaml_parser_t *parser, yaml_event_t *event)
+{
+    if (!yaml_parser_parse(parser, event))
     {
-        yaml_node_t *node = yaml_document_get_node(doc, *item);
-        if (node != NULL && parse_palette(yaml, doc, node) != 0)
+        parse_show_error(parser->problem, parser->mark);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void parser_set_marks(yaml_document_t *doc, int id, yaml_mark_t start, yaml_mark_t end)
+{
+    yaml_node_t *node = yaml_document_get_node(doc, id);
+
+    node->start_mark = start;
+    node->end_mark = end;
+}
+
+/* deep copies node id of src into dst, returning the new id or 0 */
+static int parser_copy_node(yaml_document_t *dst, yaml_document_t *src, int id)
+{
+    yaml_node_t *node = yaml_document_get_node(src, id);
+    yaml_mark_t start = node->start_mark;
+    yaml_mark_t end = node->end_mark;
+    int copy = 0;
+
+    switch (node->type)
+    {
+        case YAML_SCALAR_NODE:
+            copy = yaml_document_add_scalar(dst,
+                node->tag,
+                node->data.scalar.value,
+                (int)node->data.scalar.length,
+                node->data.scalar.style);
+            break;
+
+        case YAML_SEQUENCE_NODE:
         {
-            return -1;
+            yaml_node_item_t *item;
+
+            copy = yaml_document_add_sequence(dst,
+                node->tag,
+                node->data.sequence.style);
+            if (copy == 0)
+            {
+                return 0;
+            }
+
+            for (item = node->data.sequence.items.start;
+                 item < node->data.sequence.items.top; ++item)
+            {
+                int itemid = parser_copy_node(dst, src, *item);
+
+                if (itemid == 0 || !yaml_document_append_sequence_item(dst, copy, itemid))
+                {
+                    return 0;
+                }
+            }
+            break;
+        }
+
+        case YAML_MAPPING_NODE:
+        {
+            yaml_node_pair_t *pair;
+
+            copy = yaml_document_add_mapping(dst,
+                node->tag,
+                node->data.mapping.style);
+            if (copy == 0)
+            {
+                return 0;
+            }
+
+            for (pair = node->data.mapping.pairs.start;
+                 pair < node->data.mapping.pairs.top; ++pair)
+            {
+                int key = parser_copy_node(dst, src, pair->key);
+                int value = key == 0 ? 0 : parser_copy_node(dst, src, pair->value);
+
+                if (key == 0 || value == 0 || !yaml_document_append_mapping_pair(dst, copy, key, value))
+                {
+                    return 0;
+                }
+            }
+            break;
         }
+
+        default:
+            return 0;
+    }
+
+    if (copy != 0)
+    {
+        parser_set_marks(dst, copy, start, end);
+    }
+
+    return copy;
+}
+
+static int parser_add_anchor(struct parser_anchors *anchors, const yaml_char_t *name,
+    yaml_document_t *doc, int id)
+{
+    struct parser_anchor *anchor;
+    int copy;
+
+    if (name == NULL)
+    {
+        return 0;
+    }
+
+    anchors->anchors = memory_grow_array(anchors->anchors, &anchors->nr_anchors_alloc,
+        anchors->nr_anchors, sizeof(struct parser_anchor));
+    if (anchors->anchors == NULL)
+    {
+        anchors->nr_anchors = 0;
+        return -1;
+    }
+
+    copy = parser_copy_node(&anchors->doc, doc, id);
+    if (copy == 0)
+    {
+        LOG_ERROR("Out of memory.\n");
+        return -1;
+    }
+
+    anchor = &anchors->anchors[anchors->nr_anchors];
+    anchor->name = strings_dup((const char *)name);
+    anchor->id = copy;
+    if (anchor->name == NULL)
+    {
+        return -1;
     }
 
+    anchors->nr_anchors++;
+
     return 0;
 }
 
-static int parse_converts(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *root)
+static int parser_find_anchor(struct parser_anchors *anchors, const yaml_char_t *name)
 {
-    yaml_node_item_t *item = root->data.sequence.items.start;
-    for (; item < root->data.sequence.items.top && item != NULL; ++item)
+    /* a redefined anchor applies from its redefinition onward */
+    for (uint32_t i = anchors->nr_anchors; i > 0; --i)
     {
-        yaml_node_t *node = yaml_document_get_node(doc, *item);
-        if (node != NULL && parse_convert(yaml, doc, node) != 0)
+        if (!strcmp(anchors->anchors[i - 1].name, (const char *)name))
         {
-            return -1;
+            return anchors->anchors[i - 1].id;
         }
     }
 
     return 0;
 }
 
-static int parse_outputs(struct yaml *yaml, yaml_document_t *doc, yaml_node_t *root)
+static int parser_init_anchors(struct parser_anchors *anchors)
 {
-    yaml_node_item_t *item = root->data.sequence.items.start;
-    for (; item < root->data.sequence.items.top && item != NULL; ++item)
+    anchors->anchors = NULL;
+    anchors->nr_anchors = 0;
+    anchors->nr_anchors_alloc = 0;
+
+    if (!yaml_document_initialize(&anchors->doc, NULL, NULL, NULL, 1, 1))
     {
-        yaml_node_t *node = yaml_document_get_node(doc, *item);
-        if (node != NULL && parse_output(yaml, doc, node) != 0)
+        LOG_ERROR("Out of memory.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void parser_free_anchors(struct parser_anchors *anchors)
+{
+    for (uint32_t i = 0; i < anchors->nr_anchors; ++i)
+    {
+        memory_free(anchors->anchors[i].name);
+    }
+    memory_free(anchors->anchors);
+    anchors->anchors = NULL;
+    anchors->nr_anchors = 0;
+    anchors->nr_anchors_alloc = 0;
+
+    yaml_document_delete(&anchors->doc);
+}
+
+/* adds the node starting with event, consuming the events of its children */
+static int parser_load_node(yaml_parser_t *parser, yaml_document_t *doc,
+    struct parser_anchors *anchors, yaml_event_t *event)
+{
+    yaml_event_t child;
+    int id = 0;
+
+    switch (event->type)
+    {
+        case YAML_ALIAS_EVENT:
+            id = parser_find_anchor(anchors, event->data.alias.anchor);
+            if (id == 0)
+            {
+                LOG_ERROR("Unknown alias \'%s\'.\n", (const char *)event->data.alias.anchor);
+                parser_show_mark_error(event->start_mark);
+                return 0;
+            }
+            id = parser_copy_node(doc, &anchors->doc, id);
+            if (id == 0)
+            {
+                LOG_ERROR("Out of memory.\n");
+            }
+            return id;
+
+        case YAML_SCALAR_EVENT:
+            id = yaml_document_add_scalar(doc,
+                event->data.scalar.tag,
+                event->data.scalar.value,
+                (int)event->data.scalar.length,
+                event->data.scalar.style);
+            if (id == 0)
+            {
+                return 0;
+            }
+            parser_set_marks(doc, id, event->start_mark, event->end_mark);
+            if (parser_add_anchor(anchors, event->data.scalar.anchor, doc, id))
+            {
+                return 0;
+            }
+            return id;
+
+        case YAML_SEQUENCE_START_EVENT:
+            id = yaml_document_add_sequence(doc,
+                event->data.sequence_start.tag,
+                event->data.sequence_start.style);
+            if (id == 0)
+            {
+                return 0;
+            }
+
+            for (;;)
+            {
+                int item;
+
+                if (parser_next_event(parser, &child))
+                {
+                    return 0;
+                }
+
+                if (child.type == YAML_SEQUENCE_END_EVENT)
+                {
+                    break;
+                }
+
+                item = parser_load_node(parser, doc, anchors, &child);
+                yaml_event_delete(&child);
+                if (item == 0 || !yaml_document_append_sequence_item(doc, id, item))
+                {
+                    return 0;
+                }
+            }
+            break;
+
+        case YAML_MAPPING_START_EVENT:
+            id = yaml_document_add_mapping(doc,
+                event->data.mapping_start.tag,
+                event->data.mapping_start.style);
+            if (id == 0)
+            {
+                return 0;
+            }
+
+            for (;;)
+            {
+                int key;
+                int value;
+
+                if (parser_next_event(parser, &child))
+                {
+                    return 0;
+                }
+
+                if (child.type == YAML_MAPPING_END_EVENT)
+                {
+                    break;
+                }
+
+                key = parser_load_node(parser, doc, anchors, &child);
+                yaml_event_delete(&child);
+                if (key == 0 || parser_next_event(parser, &child))
+                {
+                    return 0;
+                }
+
+                value = parser_load_node(parser, doc, anchors, &child);
+                yaml_event_delete(&child);
+                if (value == 0 || !yaml_document_append_mapping_pair(doc, id, key, value))
+                {
+                    return 0;
+                }
+            }
+            break;
+
+        default:
+            LOG_ERROR("Unexpected YAML structure.\n");
+            parser_show_mark_error(event->start_mark);
+            return 0;
+    }
+
+    /* collections span up to their end event */
+    parser_set_marks(doc, id, event->start_mark, child.end_mark);
+    yaml_event_delete(&child);
+
+    /* collections are stored once complete, so they cannot alias themselves */
+    if (parser_add_anchor(anchors, event->type == YAML_SEQUENCE_START_EVENT ?
+            event->data.sequence_start.anchor : event->data.mapping_start.anchor, doc, id))
+    {
+        return 0;
+    }
+
+    return id;
+}
+
+/* only one entry's nodes are held at a time, however long the list is */
+static int parse_entries(struct yaml *yaml, yaml_parser_t *parser, yaml_event_t *keyev,
+    struct parser_anchors *anchors,
+    int (*parse_entry)(struct yaml *, yaml_document_t *, yaml_node_t *))
+{
+    yaml_event_t event;
+
+    if (parser_next_event(parser, &event))
+    {
+        return -1;
+    }
+
+    if (event.type != YAML_SEQUENCE_START_EVENT)
+    {
+        LOG_ERROR("Expected a list for \'%s\'.\n", (const char *)keyev->data.scalar.value);
+        parser_show_mark_error(event.start_mark);
+        yaml_event_delete(&event);
+        return -1;
+    }
+
+    yaml_event_delete(&event);
+
+    for (;;)
+    {
+        yaml_document_t doc;
+        yaml_node_t *node;
+        int ret;
+
+        if (parser_next_event(parser, &event))
+        {
+            return -1;
+        }
+
+        if (event.type == YAML_SEQUENCE_END_EVENT)
+        {
+            yaml_event_delete(&event);
+            return 0;
+        }
+
+        if (event.type != YAML_MAPPING_START_EVENT)
+        {
+            LOG_ERROR("Expected a mapping in \'%s\'.\n", (const char *)keyev->data.scalar.value);
+            parser_show_mark_error(event.start_mark);
+            yaml_event_delete(&event);
+            return -1;
+        }
+
+        if (!yaml_document_initialize(&doc, NULL, NULL, NULL, 1, 1))
+        {
+            LOG_ERROR("Out of memory.\n");
+            yaml_event_delete(&event);
+            return -1;
+        }
+
+        ret = -1;
+        if (parser_load_node(parser, &doc, anchors, &event) != 0)
+        {
+            node = yaml_document_get_root_node(&doc);
+            ret = parse_entry(yaml, &doc, node);
+        }
+
+        yaml_event_delete(&event);
+        yaml_document_delete(&doc);
+
+        if (ret != 0)
         {
             return -1;
         }
     }
+}
 
-    return 0;
+static struct convert *parser_find_convert(struct yaml *yaml, const char *name)
+{
+    uint32_t index;
+
+    if (registry_find(&yaml->convert_registry, name, &index))
+    {
+        return NULL;
+    }
+
+    return yaml->converts[index];
 }
 
 static int parser_validate(struct yaml *yaml)
@@ -1479,40 +2392,36 @@ static int parser_validate(struct yaml *yaml)
     for (i = 0; i < yaml->nr_palettes; ++i)
     {
         const char *iname = yaml->palettes[i]->name;
-        uint32_t j;
 
-        for (j = 0; j < yaml->nr_palettes; ++j)
+        switch (registry_add(&yaml->palette_registry, iname, i))
         {
-            if (j == i)
-            {
-                continue;
-            }
+            case 0:
+                break;
 
-            if (!strcmp(iname, yaml->palettes[j]->name))
-            {
+            case 1:
                 LOG_ERROR("Duplicate palette name \'%s\'", iname);
                 return -1;
-            }
+
+            default:
+                return -1;
         }
     }
 
     for (i = 0; i < yaml->nr_converts; ++i)
     {
         const char *iname = yaml->converts[i]->name;
-        uint32_t j;
 
-        for (j = 0; j < yaml->nr_converts; ++j)
+        switch (registry_add(&yaml->convert_registry, iname, i))
         {
-            if (j == i)
-            {
-                continue;
-            }
+            case 0:
+                break;
 
-            if (!strcmp(iname, yaml->converts[j]->name))
-            {
+            case 1:
                 LOG_ERROR("Duplicate convert name \'%s\'", iname);
                 return -1;
-            }
+
+            default:
+                return -1;
         }
     }
 
@@ -1562,6 +2471,113 @@ static int parser_validate(struct yaml *yaml)
                 return -1;
             }
         }
+
+        if (convert->nr_rotations)
+        {
+            if (convert->nr_variants)
+            {
+                LOG_ERROR("Convert \'%s\' cannot use both \'rotations\' and \'variants\'.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->nr_scales)
+            {
+                LOG_ERROR("Convert \'%s\' cannot use both \'rotations\' and \'scales\'.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->preshift)
+            {
+                LOG_ERROR("Convert \'%s\' cannot use both \'rotations\' and \'preshift\'.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->style == CONVERT_STYLE_COMPILED)
+            {
+                LOG_ERROR("Convert \'%s\' style does not support \'rotations\' option.\n",
+                    convert->name);
+                return -1;
+            }
+        }
+
+        if (convert->palette_banks)
+        {
+            if (convert->style != CONVERT_STYLE_PALETTE || convert->bpp != BPP_8)
+            {
+                LOG_ERROR("Convert \'%s\' \'palette-banks\' option requires the palette style "
+                    "and sets the bpp itself.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->palette_offset != 0 || convert->nr_omit_indices)
+            {
+                LOG_ERROR("Convert \'%s\' cannot use \'palette-banks\' with "
+                    "\'palette-offset\' or \'omit-indices\'.\n",
+                    convert->name);
+                return -1;
+            }
+        }
+
+        if (convert->animation == CONVERT_ANIMATION_DELTA)
+        {
+            if (convert->style != CONVERT_STYLE_PALETTE || convert->bpp != BPP_8)
+            {
+                LOG_ERROR("Convert \'%s\' \'animation\' option requires the palette style at 8 bpp.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->trim || convert->preshift || convert->masks ||
+                convert->nr_variants || convert->nr_scales || convert->nr_rotations ||
+                convert->layout != IMAGE_LAYOUT_ROW_MAJOR)
+            {
+                LOG_ERROR("Convert \'%s\' \'animation\' option cannot be combined with "
+                    "\'trim\', \'preshift\', \'masks\', \'variants\', \'scales\', "
+                    "\'rotations\' or \'layout\'.\n",
+                    convert->name);
+                return -1;
+            }
+        }
+
+        if (convert->layout != IMAGE_LAYOUT_ROW_MAJOR)
+        {
+            if (convert->style == CONVERT_STYLE_RLET ||
+                convert->style == CONVERT_STYLE_AUTO ||
+                convert->style == CONVERT_STYLE_COMPILED)
+            {
+                LOG_ERROR("Convert \'%s\' style does not support \'layout\' option; "
+                    "rlet and compiled data have no pixel grid.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->preshift)
+            {
+                LOG_ERROR("Convert \'%s\' cannot use both \'layout\' and \'preshift\'.\n",
+                    convert->name);
+                return -1;
+            }
+        }
+
+        if (convert->style == CONVERT_STYLE_COMPILED)
+        {
+            if (convert->bpp != BPP_8)
+            {
+                LOG_ERROR("Convert \'%s\' style does not support \'bpp\' option.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->nr_omit_indices)
+            {
+                LOG_ERROR("Convert \'%s\' style does not support \'omit-indices\' option.\n",
+                    convert->name);
+                return -1;
+            }
+            if (convert->nr_tilesets)
+            {
+                LOG_ERROR("Convert \'%s\' style does not support tilesets.\n",
+                    convert->name);
+                return -1;
+            }
+        }
     }
 
     for (i = 0; i < yaml->nr_outputs; ++i)
@@ -1578,73 +2594,201 @@ static int parser_validate(struct yaml *yaml)
                 return -1;
             }
 
-            free(output->include_file);
+            memory_free(output->include_file);
             output->include_file = include_file;
         }
+
+        if (output->format == OUTPUT_FORMAT_BIN || output->format == OUTPUT_FORMAT_BASIC)
+        {
+            for (uint32_t j = 0; j < output->nr_converts; ++j)
+            {
+                struct convert *convert = parser_find_convert(yaml, output->convert_names[j]);
+
+                if (convert != NULL && convert->masks)
+                {
+                    LOG_ERROR("Convert \'%s\' uses \'masks\', which this output format does not support.\n",
+                        convert->name);
+                    return -1;
+                }
+            }
+        }
+
+        if (output->format != OUTPUT_FORMAT_C && output->format != OUTPUT_FORMAT_ASM)
+        {
+            for (uint32_t j = 0; j < output->nr_converts; ++j)
+            {
+                struct convert *convert = parser_find_convert(yaml, output->convert_names[j]);
+
+                if (convert != NULL && convert->palette_banks)
+                {
+                    LOG_ERROR("Convert \'%s\' uses \'palette-banks\', which this output format does not support.\n",
+                        convert->name);
+                    return -1;
+                }
+            }
+        }
+
+        if (output->appvar.budget != 0)
+        {
+            if (output->appvar.compress != COMPRESS_NONE)
+            {
+                LOG_ERROR("AppVar \'%s\' cannot use both \'budget\' and \'compress\'.\n",
+                    output->appvar.name);
+                return -1;
+            }
+
+            /* budgeted converts are encoded again from their indices */
+            for (uint32_t j = 0; j < output->nr_converts; ++j)
+            {
+                struct convert *convert = parser_find_convert(yaml, output->convert_names[j]);
+
+                /* compiled sprites keep their own encoding */
+                if (convert == NULL || convert->style == CONVERT_STYLE_COMPILED)
+                {
+                    continue;
+                }
+
+                if (convert->preshift)
+                {
+                    LOG_ERROR("Convert \'%s\' cannot use \'preshift\' with the \'budget\' of AppVar \'%s\'.\n",
+                        convert->name, output->appvar.name);
+                    return -1;
+                }
+
+                /* the budget encodes images in place, so no other output may see them */
+                for (uint32_t k = 0; k < yaml->nr_outputs; ++k)
+                {
+                    const struct output *other = yaml->outputs[k];
+
+                    if (k == i)
+                    {
+                        continue;
+                    }
+
+                    for (uint32_t l = 0; l < other->nr_converts; ++l)
+                    {
+                        if (parser_find_convert(yaml, other->convert_names[l]) == convert)
+                        {
+                            LOG_ERROR("Convert \'%s\' is encoded by the budget of AppVar \'%s\' "
+                                "and cannot be used by another output.\n",
+                                convert->name, output->appvar.name);
+                            return -1;
+                        }
+                    }
+                }
+
+                convert->keep_indices = true;
+            }
+        }
     }
 
     return 0;
 }
 
-static int parse_yaml(struct yaml *yaml, yaml_document_t *doc)
+static int parse_yaml(struct yaml *yaml, yaml_parser_t *parser)
 {
-    yaml_node_t *root = yaml_document_get_root_node(doc);
-    yaml_node_pair_t *pair;
+    struct parser_anchors anchors;
+    yaml_event_type_t type;
+    yaml_event_t event;
+    int ret;
 
-    if (root == NULL || root->type != YAML_MAPPING_NODE)
+    /* skip to the root node of the first document */
+    do
     {
-        LOG_ERROR("No valid YAML structures found in input file.\n");
-        if (root != NULL)
+        if (parser_next_event(parser, &event))
         {
-            parser_show_mark_error(root->start_mark);
+            return -1;
+        }
+
+        type = event.type;
+        yaml_event_delete(&event);
+
+        if (type == YAML_STREAM_END_EVENT)
+        {
+            LOG_ERROR("No valid YAML structures found in input file.\n");
+            return -1;
         }
+    } while (type != YAML_DOCUMENT_START_EVENT);
+
+    if (parser_next_event(parser, &event))
+    {
         return -1;
     }
 
-    pair = root->data.mapping.pairs.start;
-    for (; pair < root->data.mapping.pairs.top; ++pair)
+    if (event.type != YAML_MAPPING_START_EVENT)
     {
-        yaml_node_t *keyn = yaml_document_get_node(doc, pair->key);
-        yaml_node_t *valuen = yaml_document_get_node(doc, pair->value);
-        int ret;
+        LOG_ERROR("No valid YAML structures found in input file.\n");
+        parser_show_mark_error(event.start_mark);
+        yaml_event_delete(&event);
+        return -1;
+    }
 
-        if (keyn == NULL || valuen == NULL)
+    yaml_event_delete(&event);
+
+    if (parser_init_anchors(&anchors))
+    {
+        return -1;
+    }
+
+    for (;;)
+    {
+        if (parser_next_event(parser, &event))
         {
-            continue;
+            ret = -1;
+            break;
         }
 
-        if (parse_str_cmp("palettes", keyn->data.scalar.value))
+        if (event.type == YAML_MAPPING_END_EVENT)
         {
-            ret = parse_palettes(yaml, doc, valuen);
+            yaml_event_delete(&event);
+            ret = 0;
+            break;
         }
-        else if (parse_str_cmp("converts", keyn->data.scalar.value))
+
+        if (event.type != YAML_SCALAR_EVENT)
+        {
+            LOG_ERROR("Unknown YAML option.\n");
+            parser_show_mark_error(event.start_mark);
+            yaml_event_delete(&event);
+            ret = -1;
+            break;
+        }
+
+        if (parse_str_cmp("palettes", event.data.scalar.value))
         {
-            ret = parse_converts(yaml, doc, valuen);
+            ret = parse_entries(yaml, parser, &event, &anchors, parse_palette);
         }
-        else if (parse_str_cmp("outputs", keyn->data.scalar.value))
+        else if (parse_str_cmp("converts", event.data.scalar.value))
         {
-            ret = parse_outputs(yaml, doc, valuen);
+            ret = parse_entries(yaml, parser, &event, &anchors, parse_convert);
+        }
+        else if (parse_str_cmp("outputs", event.data.scalar.value))
+        {
+            ret = parse_entries(yaml, parser, &event, &anchors, parse_output);
         }
         else
         {
-            LOG_ERROR("Unknown YAML option: \'%s\'\n", keyn->data.scalar.value);
-            parser_show_mark_error(keyn->start_mark);
+            LOG_ERROR("Unknown YAML option: \'%s\'\n", event.data.scalar.value);
+            parser_show_mark_error(event.start_mark);
             ret = -1;
         }
 
+        yaml_event_delete(&event);
+
         if (ret != 0)
         {
-            return ret;
+            break;
         }
     }
 
-    return 0;
+    parser_free_anchors(&anchors);
+
+    return ret;
 }
 
 int parser_open(struct yaml *yaml, const char *path)
 {
     yaml_parser_t parser;
-    yaml_document_t document;
     FILE *fd;
     int ret;
 
@@ -1680,17 +2824,12 @@ int parser_open(struct yaml *yaml, const char *path)
     }
 
     yaml_parser_set_input_file(&parser, fd);
-    if (!yaml_parser_load(&parser, &document))
-    {
-        parse_show_error(parser.problem, parser.mark);
-        yaml_parser_delete(&parser);
-        fclose(fd);
-        return -1;
-    }
 
-    ret = parse_yaml(yaml, &document);
+    ret = parse_yaml(yaml, &parser);
+
+    /* every path has been expanded, so the listings are no longer needed */
+    dircache_free();
 
-    yaml_document_delete(&document);
     yaml_parser_delete(&parser);
 
     fclose(fd);
@@ -1707,36 +2846,39 @@ void parser_close(struct yaml *yaml)
 {
     uint32_t i;
 
+    registry_free(&yaml->palette_registry);
+    registry_free(&yaml->convert_registry);
+
     for (i = 0; i < yaml->nr_outputs; ++i)
     {
         output_free(yaml->outputs[i]);
-        free(yaml->outputs[i]);
+        memory_free(yaml->outputs[i]);
         yaml->outputs[i] = NULL;
     }
 
-    free(yaml->outputs);
+    memory_free(yaml->outputs);
     yaml->outputs = NULL;
 
     for (i = 0; i < yaml->nr_converts; ++i)
     {
         convert_free(yaml->converts[i]);
-        free(yaml->converts[i]);
+        memory_free(yaml->converts[i]);
         yaml->converts[i] = NULL;
     }
 
-    free(yaml->converts);
+    memory_free(yaml->converts);
     yaml->converts = NULL;
 
     for (i = 0; i < yaml->nr_palettes; ++i)
     {
         palette_free(yaml->palettes[i]);
-        free(yaml->palettes[i]);
+        memory_free(yaml->palettes[i]);
         yaml->palettes[i] = NULL;
     }
 
-    free(yaml->palettes);
+    memory_free(yaml->palettes);
     yaml->palettes = NULL;
 
-    free(yaml->path);
+    memory_free(yaml->path);
     yaml->path = NULL;
 }
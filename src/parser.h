@@ -34,6 +34,7 @@
 #include "palette.h"
 #include "convert.h"
 #include "output.h"
+#include "registry.h"
 
 #include <stdint.h>
 
@@ -53,6 +54,13 @@ struct yaml
     uint32_t nr_palettes;
     uint32_t nr_converts;
     uint32_t nr_outputs;
+    uint32_t nr_palettes_alloc;
+    uint32_t nr_converts_alloc;
+    uint32_t nr_outputs_alloc;
+
+    /* built by validation, name to index */
+    struct registry palette_registry;
+    struct registry convert_registry;
 };
 
 int parser_open(struct yaml *yaml, const char *path);
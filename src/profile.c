@@ -0,0 +1,259 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "profile.h"
+#include "strings.h"
+#include "memory.h"
+#include "log.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define PROFILE_MAX_STAGES 32
+#define PROFILE_MAX_DEPTH 64
+
+struct profile_event
+{
+    const char *stage;
+    char *name;
+    uint64_t ts;
+    bool begin;
+};
+
+struct profile_stage
+{
+    const char *stage;
+    uint32_t count;
+    uint64_t total;
+};
+
+static struct
+{
+    const char *path;
+    uint64_t start;
+    struct profile_event *events;
+    uint32_t nr_events;
+    uint32_t max_events;
+    struct profile_stage stages[PROFILE_MAX_STAGES];
+    uint32_t nr_stages;
+    uint64_t open[PROFILE_MAX_DEPTH];
+    uint32_t depth;
+} profile;
+
+/* monotonic time in microseconds */
+uint64_t profile_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    return (uint64_t)((count.QuadPart * 1000000.0) / freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+#endif
+}
+
+static void profile_record(const char *stage, const char *name, bool begin)
+{
+    struct profile_event *event;
+
+    if (profile.nr_events == profile.max_events)
+    {
+        uint32_t max_events = profile.max_events ? profile.max_events * 2 : 256;
+        struct profile_event *events;
+
+        events = memory_realloc_array(profile.events, max_events, sizeof(struct profile_event));
+        if (events == NULL)
+        {
+            return;
+        }
+
+        profile.events = events;
+        profile.max_events = max_events;
+    }
+
+    event = &profile.events[profile.nr_events++];
+    event->stage = stage;
+    event->name = strings_dup(name != NULL ? name : stage);
+    event->ts = profile_now() - profile.start;
+    event->begin = begin;
+}
+
+static void profile_add_stage(const char *stage, uint64_t duration)
+{
+    uint32_t i;
+
+    for (i = 0; i < profile.nr_stages; ++i)
+    {
+        if (!strcmp(profile.stages[i].stage, stage))
+        {
+            break;
+        }
+    }
+
+    if (i == profile.nr_stages)
+    {
+        if (profile.nr_stages == PROFILE_MAX_STAGES)
+        {
+            return;
+        }
+
+        profile.stages[i].stage = stage;
+        profile.stages[i].count = 0;
+        profile.stages[i].total = 0;
+        profile.nr_stages++;
+    }
+
+    profile.stages[i].count++;
+    profile.stages[i].total += duration;
+}
+
+int profile_init(const char *path)
+{
+    profile.path = path;
+    profile.start = profile_now();
+    profile.events = NULL;
+    profile.nr_events = 0;
+    profile.max_events = 0;
+    profile.nr_stages = 0;
+    profile.depth = 0;
+
+    return 0;
+}
+
+/* stage names must be string literals; only the name is copied */
+void profile_begin(const char *stage, const char *name)
+{
+    if (profile.path == NULL)
+    {
+        return;
+    }
+
+    if (profile.depth < PROFILE_MAX_DEPTH)
+    {
+        profile.open[profile.depth] = profile_now();
+    }
+    profile.depth++;
+
+    profile_record(stage, name, true);
+}
+
+void profile_end(const char *stage, const char *name)
+{
+    if (profile.path == NULL || profile.depth == 0)
+    {
+        return;
+    }
+
+    profile.depth--;
+    if (profile.depth < PROFILE_MAX_DEPTH)
+    {
+        profile_add_stage(stage, profile_now() - profile.open[profile.depth]);
+    }
+
+    profile_record(stage, name, false);
+}
+
+/* writes chrome trace events, prints the per-stage summary and stops profiling */
+int profile_finish(void)
+{
+    FILE *fd;
+    int ret = 0;
+
+    if (profile.path == NULL)
+    {
+        return 0;
+    }
+
+    fd = fopen(profile.path, "wt");
+    if (fd == NULL)
+    {
+        LOG_ERROR("Could not open profile \'%s\': %s\n", profile.path, strerror(errno));
+        ret = -1;
+    }
+    else
+    {
+        fprintf(fd, "{\"traceEvents\":[\n");
+
+        for (uint32_t i = 0; i < profile.nr_events; ++i)
+        {
+            const struct profile_event *event = &profile.events[i];
+
+            fprintf(fd, "{\"name\":");
+            strings_write_json(fd, event->name != NULL ? event->name : event->stage);
+            fprintf(fd, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":1}%s\n",
+                event->stage,
+                event->begin ? 'B' : 'E',
+                (unsigned long long)event->ts,
+                i + 1 < profile.nr_events ? "," : "");
+        }
+
+        fprintf(fd, "],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(fd);
+    }
+
+    LOG_PRINT("[profile] %-12s %8s %12s\n", "stage", "count", "total ms");
+    for (uint32_t i = 0; i < profile.nr_stages; ++i)
+    {
+        const struct profile_stage *stage = &profile.stages[i];
+
+        LOG_PRINT("[profile] %-12s %8u %12.3f\n",
+            stage->stage,
+            stage->count,
+            stage->total / 1000.0);
+    }
+
+    for (uint32_t i = 0; i < profile.nr_events; ++i)
+    {
+        memory_free(profile.events[i].name);
+    }
+
+    memory_free(profile.events);
+    profile.events = NULL;
+    profile.nr_events = 0;
+    profile.max_events = 0;
+    profile.path = NULL;
+
+    return ret;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "registry.h"
+#include "memory.h"
+#include "log.h"
+
+#include <string.h>
+
+#define REGISTRY_MIN_SLOTS 64
+
+/* fnv-1a */
+static uint32_t registry_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* returns the slot holding name, or the empty slot where it belongs */
+static uint32_t registry_slot(const struct registry *registry, const char *name)
+{
+    uint32_t mask = registry->nr_slots - 1;
+    uint32_t slot = registry_hash(name) & mask;
+
+    while (registry->names[slot] != NULL && strcmp(registry->names[slot], name))
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static int registry_resize(struct registry *registry, uint32_t nr_slots)
+{
+    struct registry resized;
+
+    resized.names = memory_realloc_array(NULL, nr_slots, sizeof(const char *));
+    resized.indices = memory_realloc_array(NULL, nr_slots, sizeof(uint32_t));
+    if (resized.names == NULL || resized.indices == NULL)
+    {
+        memory_free(resized.names);
+        memory_free(resized.indices);
+        return -1;
+    }
+
+    resized.nr_slots = nr_slots;
+    resized.nr_names = registry->nr_names;
+
+    for (uint32_t i = 0; i < nr_slots; ++i)
+    {
+        resized.names[i] = NULL;
+    }
+
+    for (uint32_t i = 0; i < registry->nr_slots; ++i)
+    {
+        if (registry->names[i] != NULL)
+        {
+            uint32_t slot = registry_slot(&resized, registry->names[i]);
+
+            resized.names[slot] = registry->names[i];
+            resized.indices[slot] = registry->indices[i];
+        }
+    }
+
+    registry_free(registry);
+    *registry = resized;
+
+    return 0;
+}
+
+void registry_init(struct registry *registry)
+{
+    registry->names = NULL;
+    registry->indices = NULL;
+    registry->nr_slots = 0;
+    registry->nr_names = 0;
+}
+
+void registry_free(struct registry *registry)
+{
+    memory_free(registry->names);
+    memory_free(registry->indices);
+    registry_init(registry);
+}
+
+/* returns 1 without replacing the index if the name is already registered */
+int registry_add(struct registry *registry, const char *name, uint32_t index)
+{
+    uint32_t slot;
+
+    /* keep the table at most half full so probes stay short */
+    if ((registry->nr_names + 1) * 2 > registry->nr_slots)
+    {
+        uint32_t nr_slots = registry->nr_slots ? registry->nr_slots * 2 : REGISTRY_MIN_SLOTS;
+
+        if (registry->nr_slots > UINT32_MAX / 4)
+        {
+            LOG_ERROR("Out of memory.\n");
+            return -1;
+        }
+
+        if (registry_resize(registry, nr_slots))
+        {
+            return -1;
+        }
+    }
+
+    slot = registry_slot(registry, name);
+    if (registry->names[slot] != NULL)
+    {
+        return 1;
+    }
+
+    registry->names[slot] = name;
+    registry->indices[slot] = index;
+    registry->nr_names++;
+
+    return 0;
+}
+
+int registry_find(const struct registry *registry, const char *name, uint32_t *index)
+{
+    uint32_t slot;
+
+    if (registry->nr_slots == 0)
+    {
+        return -1;
+    }
+
+    slot = registry_slot(registry, name);
+    if (registry->names[slot] == NULL)
+    {
+        return -1;
+    }
+
+    *index = registry->indices[slot];
+
+    return 0;
+}
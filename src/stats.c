@@ -0,0 +1,615 @@
+/*
+ * Copyright 2017-2024 Matt "MateoConLechuga" Waltz
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stats.h"
+#include "profile.h"
+#include "strings.h"
+#include "memory.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+struct stats_stage
+{
+    const char *stage;
+    uint32_t count;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t duration;
+};
+
+struct stats_counters
+{
+    uint32_t nr_images;
+    uint64_t pixels;
+    uint32_t nr_quantizes;
+    struct stats_stage *stages;
+    uint32_t nr_stages;
+    uint32_t nr_stages_alloc;
+};
+
+/* names are borrowed from the parsed yaml, which outlives the stats */
+struct stats_convert
+{
+    const char *name;
+    struct stats_counters counters;
+};
+
+struct stats_palette
+{
+    const char *name;
+    uint32_t nr_entries;
+    uint32_t nr_unique;
+};
+
+struct stats_output
+{
+    const char *type;
+    const char *name;
+    uint32_t nr_files;
+    uint64_t bytes;
+};
+
+static struct
+{
+    stats_format_t format;
+    uint64_t start;
+    struct stats_counters total;
+    struct stats_palette *palettes;
+    uint32_t nr_palettes;
+    uint32_t nr_palettes_alloc;
+    uint32_t *colors;
+    uint32_t nr_colors;
+    uint32_t nr_colors_alloc;
+    bool has_transparent;
+    struct stats_convert *converts;
+    uint32_t nr_converts;
+    uint32_t nr_converts_alloc;
+    struct stats_output *outputs;
+    uint32_t nr_outputs;
+    uint32_t nr_outputs_alloc;
+    char **files;
+    uint32_t nr_files;
+    uint32_t nr_files_alloc;
+    int32_t convert;
+    int32_t output;
+} stats;
+
+static void stats_add_stage(struct stats_counters *counters,
+    const char *stage, size_t bytes_in, size_t bytes_out, uint64_t duration)
+{
+    uint32_t i;
+
+    for (i = 0; i < counters->nr_stages; ++i)
+    {
+        if (!strcmp(counters->stages[i].stage, stage))
+        {
+            break;
+        }
+    }
+
+    if (i == counters->nr_stages)
+    {
+        counters->stages = memory_grow_array(counters->stages, &counters->nr_stages_alloc,
+            counters->nr_stages, sizeof(struct stats_stage));
+        if (counters->stages == NULL)
+        {
+            counters->nr_stages = 0;
+            return;
+        }
+
+        memset(&counters->stages[i], 0, sizeof(struct stats_stage));
+        counters->stages[i].stage = stage;
+        counters->nr_stages++;
+    }
+
+    counters->stages[i].count++;
+    counters->stages[i].bytes_in += bytes_in;
+    counters->stages[i].bytes_out += bytes_out;
+    counters->stages[i].duration += duration;
+}
+
+static struct stats_counters *stats_convert_counters(void)
+{
+    if (stats.format == STATS_NONE || stats.convert < 0)
+    {
+        return NULL;
+    }
+
+    return &stats.converts[stats.convert].counters;
+}
+
+void stats_init(stats_format_t format)
+{
+    memset(&stats, 0, sizeof stats);
+    stats.format = format;
+    stats.start = profile_now();
+    stats.convert = -1;
+    stats.output = -1;
+}
+
+/* converts may be generated while an output is open in streaming mode */
+void stats_begin_convert(const char *name)
+{
+    struct stats_convert *convert;
+
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    stats.converts = memory_grow_array(stats.converts, &stats.nr_converts_alloc,
+        stats.nr_converts, sizeof(struct stats_convert));
+    if (stats.converts == NULL)
+    {
+        stats.nr_converts = 0;
+        stats.convert = -1;
+        return;
+    }
+
+    convert = &stats.converts[stats.nr_converts];
+    memset(convert, 0, sizeof(struct stats_convert));
+    convert->name = name;
+
+    stats.convert = stats.nr_converts++;
+}
+
+void stats_end_convert(void)
+{
+    stats.convert = -1;
+}
+
+void stats_begin_output(const char *type, const char *name)
+{
+    struct stats_output *output;
+
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    stats.outputs = memory_grow_array(stats.outputs, &stats.nr_outputs_alloc,
+        stats.nr_outputs, sizeof(struct stats_output));
+    if (stats.outputs == NULL)
+    {
+        stats.nr_outputs = 0;
+        stats.output = -1;
+        return;
+    }
+
+    output = &stats.outputs[stats.nr_outputs];
+    output->type = type;
+    output->name = name;
+    output->nr_files = 0;
+    output->bytes = 0;
+
+    stats.output = stats.nr_outputs++;
+}
+
+/* file sizes are only final once the writers have closed them */
+void stats_end_output(void)
+{
+    for (uint32_t i = 0; i < stats.nr_files; ++i)
+    {
+        struct stat st;
+
+        if (stats.output >= 0 && stat(stats.files[i], &st) == 0)
+        {
+            stats.outputs[stats.output].nr_files++;
+            stats.outputs[stats.output].bytes += st.st_size;
+        }
+
+        memory_free(stats.files[i]);
+    }
+
+    stats.nr_files = 0;
+    stats.output = -1;
+}
+
+void stats_decode(uint32_t width, uint32_t height)
+{
+    struct stats_counters *counters = stats_convert_counters();
+
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    stats.total.nr_images++;
+    stats.total.pixels += (uint64_t)width * height;
+
+    if (counters != NULL)
+    {
+        counters->nr_images++;
+        counters->pixels += (uint64_t)width * height;
+    }
+}
+
+void stats_quantize(void)
+{
+    struct stats_counters *counters = stats_convert_counters();
+
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    stats.total.nr_quantizes++;
+
+    if (counters != NULL)
+    {
+        counters->nr_quantizes++;
+    }
+}
+
+/* open addressing, with 0 marking a free slot since opaque colors are never 0 */
+static void stats_insert_color(uint32_t rgba)
+{
+    uint32_t mask = stats.nr_colors_alloc - 1;
+    uint32_t i = (rgba * 2654435761u) & mask;
+
+    while (stats.colors[i] != 0)
+    {
+        if (stats.colors[i] == rgba)
+        {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    stats.colors[i] = rgba;
+    stats.nr_colors++;
+}
+
+static bool stats_add_color(uint32_t rgba)
+{
+    /* keep the load under half so probes stay short */
+    if ((stats.nr_colors + 1) * 2 > stats.nr_colors_alloc)
+    {
+        uint32_t *old = stats.colors;
+        uint32_t nr_old = stats.nr_colors_alloc;
+
+        stats.nr_colors_alloc = nr_old == 0 ? 4096 : nr_old * 2;
+        stats.colors = memory_realloc_array(NULL, stats.nr_colors_alloc, sizeof(uint32_t));
+        if (stats.colors == NULL)
+        {
+            stats.colors = old;
+            stats.nr_colors_alloc = nr_old;
+            return false;
+        }
+
+        memset(stats.colors, 0, stats.nr_colors_alloc * sizeof(uint32_t));
+        stats.nr_colors = 0;
+
+        for (uint32_t i = 0; i < nr_old; ++i)
+        {
+            if (old[i] != 0)
+            {
+                stats_insert_color(old[i]);
+            }
+        }
+        memory_free(old);
+    }
+
+    stats_insert_color(rgba);
+
+    return true;
+}
+
+/* colors read from a palette's images, before they are quantized */
+void stats_source_colors(const uint32_t *rgba, uint32_t count)
+{
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        struct color color;
+
+        color.rgba = rgba[i];
+
+        /* transparent pixels all look the same, whatever their rgb */
+        if (color.a < 128)
+        {
+            stats.has_transparent = true;
+            continue;
+        }
+
+        color.a = 255;
+
+        if (!stats_add_color(color.rgba))
+        {
+            return;
+        }
+    }
+}
+
+void stats_palette(const struct palette *palette)
+{
+    struct stats_palette *entry;
+
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    stats.palettes = memory_grow_array(stats.palettes, &stats.nr_palettes_alloc,
+        stats.nr_palettes, sizeof(struct stats_palette));
+    if (stats.palettes == NULL)
+    {
+        stats.nr_palettes = 0;
+        return;
+    }
+
+    entry = &stats.palettes[stats.nr_palettes++];
+    entry->name = palette->name;
+    entry->nr_entries = palette->nr_entries;
+    entry->nr_unique = stats.nr_colors + stats.has_transparent;
+
+    /* the next palette starts counting from scratch */
+    if (stats.colors != NULL)
+    {
+        memset(stats.colors, 0, stats.nr_colors_alloc * sizeof(uint32_t));
+    }
+    stats.nr_colors = 0;
+    stats.has_transparent = false;
+}
+
+/* stage names must be string literals */
+void stats_stage(const char *stage, size_t bytes_in, size_t bytes_out, uint64_t duration)
+{
+    struct stats_counters *counters = stats_convert_counters();
+
+    if (stats.format == STATS_NONE)
+    {
+        return;
+    }
+
+    stats_add_stage(&stats.total, stage, bytes_in, bytes_out, duration);
+
+    if (counters != NULL)
+    {
+        stats_add_stage(counters, stage, bytes_in, bytes_out, duration);
+    }
+}
+
+void stats_file(const char *path)
+{
+    char *name;
+
+    if (stats.format == STATS_NONE || stats.output < 0)
+    {
+        return;
+    }
+
+    name = strings_dup(path);
+    if (name == NULL)
+    {
+        return;
+    }
+
+    stats.files = memory_grow_array(stats.files, &stats.nr_files_alloc,
+        stats.nr_files, sizeof(char *));
+    if (stats.files == NULL)
+    {
+        memory_free(name);
+        stats.nr_files = 0;
+        return;
+    }
+
+    stats.files[stats.nr_files++] = name;
+}
+
+static double stats_ratio(const struct stats_stage *stage)
+{
+    return stage->bytes_in ? (double)stage->bytes_out / stage->bytes_in : 0.0;
+}
+
+static void stats_print_counters(const char *name, const struct stats_counters *counters)
+{
+    LOG_PRINT("[stats] %-24s %8u images %12llu pixels %6u quantizes\n",
+        name,
+        counters->nr_images,
+        (unsigned long long)counters->pixels,
+        counters->nr_quantizes);
+
+    for (uint32_t i = 0; i < counters->nr_stages; ++i)
+    {
+        const struct stats_stage *stage = &counters->stages[i];
+
+        LOG_PRINT("[stats]   %-22s %8u calls %10llu -> %10llu bytes (%.3f) %10.3f ms\n",
+            stage->stage,
+            stage->count,
+            (unsigned long long)stage->bytes_in,
+            (unsigned long long)stage->bytes_out,
+            stats_ratio(stage),
+            stage->duration / 1000.0);
+    }
+}
+
+static void stats_print_text(void)
+{
+    uint64_t bytes = 0;
+    uint32_t nr_files = 0;
+
+    stats_print_counters("total", &stats.total);
+
+    for (uint32_t i = 0; i < stats.nr_palettes; ++i)
+    {
+        const struct stats_palette *palette = &stats.palettes[i];
+
+        LOG_PRINT("[stats] palette %-16s %8u entries %6u unique colors\n",
+            palette->name,
+            palette->nr_entries,
+            palette->nr_unique);
+    }
+
+    for (uint32_t i = 0; i < stats.nr_converts; ++i)
+    {
+        stats_print_counters(stats.converts[i].name, &stats.converts[i].counters);
+    }
+
+    for (uint32_t i = 0; i < stats.nr_outputs; ++i)
+    {
+        const struct stats_output *output = &stats.outputs[i];
+
+        LOG_PRINT("[stats] output %-6s %-10s %8u files %12llu bytes\n",
+            output->type,
+            output->name,
+            output->nr_files,
+            (unsigned long long)output->bytes);
+
+        nr_files += output->nr_files;
+        bytes += output->bytes;
+    }
+
+    LOG_PRINT("[stats] %-24s %8u files %12llu bytes %10.3f ms\n",
+        "written",
+        nr_files,
+        (unsigned long long)bytes,
+        (profile_now() - stats.start) / 1000.0);
+}
+
+static void stats_write_counters(FILE *fd, const struct stats_counters *counters)
+{
+    fprintf(fd, "\"images\":%u,\"pixels\":%llu,\"quantizes\":%u,\"stages\":{",
+        counters->nr_images,
+        (unsigned long long)counters->pixels,
+        counters->nr_quantizes);
+
+    for (uint32_t i = 0; i < counters->nr_stages; ++i)
+    {
+        const struct stats_stage *stage = &counters->stages[i];
+
+        fprintf(fd, "%s\"%s\":{\"calls\":%u,\"bytes_in\":%llu,\"bytes_out\":%llu,\"ratio\":%.4f,\"ms\":%.3f}",
+            i ? "," : "",
+            stage->stage,
+            stage->count,
+            (unsigned long long)stage->bytes_in,
+            (unsigned long long)stage->bytes_out,
+            stats_ratio(stage),
+            stage->duration / 1000.0);
+    }
+
+    fputc('}', fd);
+}
+
+/* json bypasses the log level so it can be captured with -l 0 */
+static void stats_write_json(FILE *fd)
+{
+    uint64_t bytes = 0;
+    uint32_t nr_files = 0;
+
+    fputc('{', fd);
+    stats_write_counters(fd, &stats.total);
+
+    fprintf(fd, ",\"palettes\":[");
+    for (uint32_t i = 0; i < stats.nr_palettes; ++i)
+    {
+        const struct stats_palette *palette = &stats.palettes[i];
+
+        fprintf(fd, "%s{\"name\":", i ? "," : "");
+        strings_write_json(fd, palette->name);
+        fprintf(fd, ",\"entries\":%u,\"unique_colors\":%u}",
+            palette->nr_entries,
+            palette->nr_unique);
+    }
+
+    fprintf(fd, "],\"converts\":[");
+    for (uint32_t i = 0; i < stats.nr_converts; ++i)
+    {
+        fprintf(fd, "%s{\"name\":", i ? "," : "");
+        strings_write_json(fd, stats.converts[i].name);
+        fputc(',', fd);
+        stats_write_counters(fd, &stats.converts[i].counters);
+        fputc('}', fd);
+    }
+
+    fprintf(fd, "],\"outputs\":[");
+    for (uint32_t i = 0; i < stats.nr_outputs; ++i)
+    {
+        const struct stats_output *output = &stats.outputs[i];
+
+        fprintf(fd, "%s{\"type\":\"%s\",\"name\":", i ? "," : "", output->type);
+        strings_write_json(fd, output->name);
+        fprintf(fd, ",\"files\":%u,\"bytes\":%llu}",
+            output->nr_files,
+            (unsigned long long)output->bytes);
+
+        nr_files += output->nr_files;
+        bytes += output->bytes;
+    }
+
+    fprintf(fd, "],\"files\":%u,\"bytes\":%llu,\"ms\":%.3f}\n",
+        nr_files,
+        (unsigned long long)bytes,
+        (profile_now() - stats.start) / 1000.0);
+}
+
+/* prints the collected counters and stops collecting */
+void stats_finish(void)
+{
+    switch (stats.format)
+    {
+        case STATS_TEXT:
+            stats_print_text();
+            break;
+
+        case STATS_JSON:
+            log_flush();
+            stats_write_json(stdout);
+            fflush(stdout);
+            break;
+
+        default:
+            break;
+    }
+
+    stats_end_output();
+
+    for (uint32_t i = 0; i < stats.nr_converts; ++i)
+    {
+        memory_free(stats.converts[i].counters.stages);
+    }
+
+    memory_free(stats.total.stages);
+    memory_free(stats.palettes);
+    memory_free(stats.colors);
+    memory_free(stats.converts);
+    memory_free(stats.outputs);
+    memory_free(stats.files);
+    memset(&stats, 0, sizeof stats);
+    stats.convert = -1;
+    stats.output = -1;
+}
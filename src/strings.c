@@ -29,6 +29,7 @@
  */
 
 #include "strings.h"
+#include "dircache.h"
 #include "memory.h"
 #include "log.h"
 
@@ -128,7 +129,7 @@ char *strings_trim(char *str)
 
 char *strings_basename(const char *path)
 {
-    char *ret = strdup(path);
+    char *ret = strings_dup(path);
     char *tmp;
 
     tmp = strrchr(ret, '/');
@@ -195,7 +196,7 @@ char *strings_find_images(const char *full_path, glob_t *globbuf)
     }
     else
     {
-        path = strdup(full_path);
+        path = strings_dup(full_path);
     }
 
     if (path == NULL)
@@ -203,7 +204,7 @@ char *strings_find_images(const char *full_path, glob_t *globbuf)
         return NULL;
     }
 
-    glob(path, 0, NULL, globbuf);
+    dircache_glob(path, globbuf);
 
     return path;
 }
@@ -318,7 +319,8 @@ bool strings_hex_color(const char *str, struct color *color)
     }
 
     /* ensures always a zero terminator */
-    memcpy(value, &str[1], 12);
+    size_t n = strnlen(&str[1], 12);
+    memcpy(value, &str[1], n);
 
     int len = strlen(value);
     int r;
@@ -368,3 +370,29 @@ bool strings_hex_color(const char *str, struct color *color)
 
     return true;
 }
+
+/* writes str as a quoted json string */
+void strings_write_json(FILE *fd, const char *str)
+{
+    fputc('\"', fd);
+
+    for (; *str != '\0'; ++str)
+    {
+        unsigned char c = *str;
+
+        if (c == '\"' || c == '\\')
+        {
+            fprintf(fd, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(fd, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, fd);
+        }
+    }
+
+    fputc('\"', fd);
+}
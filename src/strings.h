@@ -35,6 +35,7 @@
 
 #include <glob.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -59,6 +60,8 @@ int strings_utf8_to_iso8859_1(const char *in, int inlen, char *out, int maxlen);
 
 bool strings_hex_color(const char *str, struct color *color);
 
+void strings_write_json(FILE *fd, const char *str);
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,17 +41,21 @@ void tileset_free_tiles(struct tileset *tileset)
     {
         if (tileset->tiles != NULL)
         {
-            free(tileset->tiles[i].data);
+            memory_free(tileset->tiles[i].data);
             tileset->tiles[i].data = NULL;
         }
     }
 
-    free(tileset->tiles);
+    memory_free(tileset->tiles);
     tileset->tiles = NULL;
 
+    memory_free(tileset->tile_banks);
+    tileset->tile_banks = NULL;
+
     image_free(&tileset->image);
 }
 
+/* tile data is filled in as each tile is converted */
 int tileset_alloc_tiles(struct tileset *tileset, uint32_t nr_tiles)
 {
     tileset->tiles = memory_realloc_array(NULL, nr_tiles, sizeof(struct tileset_tile));
@@ -62,18 +66,8 @@ int tileset_alloc_tiles(struct tileset *tileset, uint32_t nr_tiles)
 
     for (uint32_t i = 0; i < nr_tiles; ++i)
     {
-        uint32_t tile_dim = tileset->tile_width * tileset->tile_height;
-        uint32_t tile_data_size = tile_dim * sizeof(uint32_t);
-        uint8_t *tile_data;
-
-        tile_data = memory_alloc(tile_data_size);
-        if (tile_data == NULL)
-        {
-            return -1;
-        }
-
-        tileset->tiles[i].data_size = tile_data_size;
-        tileset->tiles[i].data = tile_data;
+        tileset->tiles[i].data_size = 0;
+        tileset->tiles[i].data = NULL;
     }
 
     tileset->nr_tiles = nr_tiles;
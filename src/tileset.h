@@ -40,6 +40,9 @@
 extern "C" {
 #endif
 
+#define TILESET_MAX_BANKS 16
+#define TILESET_BANK_SIZE 16
+
 struct tileset_tile
 {
     uint8_t *data;
@@ -62,6 +65,10 @@ struct tileset
     bool gfx;
     bool compressed;
     bool bad_alpha;
+    bool delta;
+    uint8_t banks[TILESET_MAX_BANKS * TILESET_BANK_SIZE];
+    uint32_t nr_banks;
+    uint8_t *tile_banks;
     uint32_t tile_rotate;
     bool tile_flip_x;
     bool tile_flip_y;
@@ -29,5 +29,5 @@
 
 for d in ./*/
 do
-    ( cd "$d" && echo "[test] `pwd`" ; ../../bin/convimg -i convimg.yaml ) || { exit 1; }
+    ( cd "$d" && echo "[test] `pwd`" ; ../../bin/convimg -i convimg.yaml $(cat convimg.args 2>/dev/null) ) || { exit 1; }
 done